@@ -23,3 +23,29 @@ arenas_free(struct arenas *a)
 	arena_free(a->scratch);
 	arena_free(a->eternal);
 }
+
+/*
+ * Prepare for formatting a file of the given length, sizing frames of the
+ * arenas growing in proportion to the file up front. The ratios approximate
+ * the usage reported by the memory report for typical source code.
+ */
+void
+arenas_hint(struct arenas *a, size_t len)
+{
+	arena_frame_hint(a->eternal, 16 * len);
+	arena_frame_hint(a->doc, 64 * len);
+}
+
+/*
+ * Returns the total number of bytes allocated across all arenas, including
+ * memory already released.
+ */
+size_t
+arenas_bytes(const struct arenas *a)
+{
+	return arena_get_stats(a->eternal)->bytes.total +
+	    arena_get_stats(a->scratch)->bytes.total +
+	    arena_get_stats(a->doc)->bytes.total +
+	    arena_get_stats(a->buffer)->bytes.total +
+	    arena_get_stats(a->ruler)->bytes.total;
+}
@@ -1,6 +1,8 @@
 #ifndef ARENAS_H
 #define ARENAS_H
 
+#include <stddef.h>	/* size_t */
+
 struct arenas {
 	struct arena	*eternal;
 	struct arena	*scratch;
@@ -11,5 +13,7 @@ struct arenas {
 
 void	arenas_init(struct arenas *);
 void	arenas_free(struct arenas *);
+void	arenas_hint(struct arenas *, size_t);
+size_t	arenas_bytes(const struct arenas *);
 
 #endif /* !ARENAS_H */
@@ -200,6 +200,8 @@ clang_shutdown(void)
 	MAP_FREE(clang_tokens);
 	MAP_FREE(cpp_token_types);
 	MAP_FREE(clang_identifiers);
+	/* Allow clang_init() to be called again. */
+	memset(token_types, 0, sizeof(token_types));
 }
 
 struct clang *
@@ -701,7 +703,7 @@ clang_token_emit(const struct clang *cl, struct lexer *lx,
 static int
 is_token_diff(const struct clang *cl, const struct token *tk)
 {
-	unsigned int i, n;
+	unsigned int n;
 
 	if (cl->diff == NULL)
 		return 0;
@@ -713,12 +715,8 @@ is_token_diff(const struct clang *cl, const struct token *tk)
 	if (tk->tk_type != TOKEN_CPP_DEFINE)
 		return 0;
 	n = token_lines(tk);
-	for (i = 0; i < n; i++) {
-		if (diff_get_chunk(cl->diff, tk->tk_lno + i) != NULL)
-			return 1;
-	}
-
-	return 0;
+	return n > 0 && diff_get_chunk_range(cl->diff, tk->tk_lno,
+	    tk->tk_lno + n - 1) != NULL;
 }
 
 static struct token *
@@ -0,0 +1,28 @@
+CC=			cc
+CFLAGS=			-fsanitize=address,undefined -fno-sanitize-recover=all -fno-omit-frame-pointer -g -O2 -Wall -Werror -Wextra -Wmissing-prototypes -Wpedantic -Wshadow -Wsign-conversion -Wwrite-strings -Wcast-qual -Wimplicit-fallthrough -Wformat-signedness -Waddress-of-packed-member -MD -MP
+CXX=			g++
+CXXFLAGS=		-fsanitize=address,undefined -fno-sanitize-recover=all -fno-omit-frame-pointer -g -O2 -Wall -Werror -Wextra -Wpedantic -Wshadow -Wsign-conversion -Wwrite-strings -Wcast-qual -Wimplicit-fallthrough -Wformat-signedness -Waddress-of-packed-member -MD -MP -std=c++20
+CPPFLAGS=		-I${.CURDIR}
+DEBUG=			-fsanitize=address,undefined -fno-sanitize-recover=all -fno-omit-frame-pointer -g
+AFLAGS=			-MD -MP
+ASFLAGS=		-MD -MP
+LDFLAGS=		-Wl,--fatal-warnings
+LDFLAGS_benchmark=	
+
+BINDIR?=		/usr/local/bin
+MANDIR?=		/usr/local/man
+LIBDIR?=		/usr/local/lib
+INCLUDEDIR?=		/usr/local/include
+INSTALL?=		install
+INSTALL_MAN?=		install
+OBJCOPY=		objcopy
+
+NO_SANITIZE_FUZZER=	
+
+.SUFFIXES: .c .cc .o .S
+.c.o:
+	${CC} ${CPPFLAGS} ${CFLAGS} ${DEBUG} -c -o $@ $<
+.cc.o:
+	${CXX} ${CPPFLAGS} ${CXXFLAGS} ${DEBUG} -c -o $@ $<
+.S.o:
+	${CC} ${CPPFLAGS} ${CFLAGS} ${DEBUG} -c -o $@ $<
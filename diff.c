@@ -4,18 +4,16 @@
 
 #include <sys/stat.h>
 
+#include <ctype.h>
 #include <err.h>
 #include <errno.h>
-#include <limits.h>	/* PATH_MAX */
-#include <regex.h>
+#include <limits.h>	/* UINT_MAX */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#include "libks/arena-buffer.h"
 #include "libks/arena.h"
-#include "libks/buffer.h"
-#include "libks/compiler.h"
 #include "libks/vector.h"
 
 #include "file.h"
@@ -24,7 +22,11 @@
 #include "trace-types.h"
 #include "trace.h"
 
+static int	diff_emit(struct file *, const struct diff_callbacks *,
+    const struct options *);
 static void	diff_end(struct diffchunk *, unsigned int);
+static int	diffchunk_cmp(const struct diffchunk *,
+    const struct diffchunk *);
 
 static int	matchpath(const char *, const char **, struct arena_scope *);
 static int	matchchunk(const char *, unsigned int *, unsigned int *);
@@ -32,8 +34,6 @@ static int	matchline(const char *, unsigned int, struct file *);
 
 static const char	*trimprefix(const char *, size_t *);
 
-static regex_t	rechunk, repath;
-
 /*
  * Number of directories above the current working directory where a Git
  * repository resides. Used to adjust diff paths when invoking knfmt from a
@@ -44,62 +44,41 @@ static int	git_ndirs;
 void
 diff_init(void)
 {
-	struct {
-		regex_t		*r;
-		const char	*p;
-	} patterns[] = {
-		{ &rechunk,	"^@@.+\\+([[:digit:]]+)(,([[:digit:]]+))?.+@@" },
-		{ &repath,	"^\\+\\+\\+[[:space:]]+([^[:space:]]+)" },
-	};
-	size_t i;
 	int fd;
 
-	for (i = 0; i < countof(patterns); i++) {
-		char errbuf[128];
-		int error;
-
-		error = regcomp(patterns[i].r, patterns[i].p,
-		    REG_EXTENDED | REG_NEWLINE);
-		if (error == 0)
-			continue;
-
-		if (regerror(error, patterns[i].r, errbuf, sizeof(errbuf)) > 0)
-			errx(1, "regcomp: %s", errbuf);
-	}
-
 	fd = searchpath(".git", &git_ndirs);
 	if (fd != -1)
 		close(fd);
 }
 
-void
-diff_shutdown(void)
-{
-	regfree(&rechunk);
-	regfree(&repath);
-}
-
+/*
+ * Parse the unified diff read from the given stream. Each file is handed to the
+ * given callback as soon as all of its chunks are known, allowing formatting
+ * of the file to commence while the remaining diff is still being read.
+ */
 int
-diff_parse(struct files *files, struct arena_scope *eternal_scope,
+diff_parse(FILE *fp, const char *name, struct files *files,
+    const struct diff_callbacks *cb, struct arena_scope *eternal_scope,
     struct arena *scratch, const struct options *op)
 {
-	struct buffer *bf;
-	struct buffer_getline it = {0};
 	struct file *fe = NULL;
-	const char *line;
+	char *line = NULL;
+	size_t linesiz = 0;
 	int error = 0;
 
 	arena_scope(scratch, s);
 
-	bf = arena_buffer_read(&s, "/dev/stdin");
-	if (bf == NULL)
-		return 1;
-
-	while ((line = arena_buffer_getline(&s, bf, &it)) != NULL) {
+	while (getline(&line, &linesiz, fp) != -1) {
 		const char *path;
 		unsigned int el, sl;
 
 		if (matchpath(line, &path, &s)) {
+			/*
+			 * The file must be emitted before allocating the next
+			 * one as the files vector could be reallocated.
+			 */
+			if (fe != NULL && diff_emit(fe, cb, op))
+				error = 1;
 			fe = files_alloc(files, path, eternal_scope);
 		} else if (matchchunk(line, &sl, &el)) {
 			/* Chunks cannot be present before the path. */
@@ -109,8 +88,7 @@ diff_parse(struct files *files, struct arena_scope *eternal_scope,
 			}
 
 			while (sl <= el) {
-				line = arena_buffer_getline(&s, bf, &it);
-				if (line == NULL) {
+				if (getline(&line, &linesiz, fp) == -1) {
 					error = 1;
 					goto out;
 				}
@@ -122,39 +100,70 @@ diff_parse(struct files *files, struct arena_scope *eternal_scope,
 			diff_end(fe->fe_diff, el);
 		}
 	}
-
-	if (options_trace_level(op, TRACE_DIFF) > 0) {
-		size_t i;
-
-		for (i = 0; i < VECTOR_LENGTH(files->fs_vc); i++) {
-			size_t j;
-
-			fe = &files->fs_vc[i];
-			for (j = 0; j < VECTOR_LENGTH(fe->fe_diff); j++) {
-				const struct diffchunk *du = &fe->fe_diff[j];
-
-				trace(TRACE_DIFF, op, "%s: %u-%u",
-				    fe->fe_path, du->du_beg, du->du_end);
-			}
-		}
+	if (ferror(fp)) {
+		warn("%s", name);
+		error = 1;
+		goto out;
 	}
 
+	if (fe != NULL && diff_emit(fe, cb, op))
+		error = 1;
+
 out:
+	free(line);
 	return error;
 }
 
 const struct diffchunk *
 diff_get_chunk(const struct diffchunk *chunks, unsigned int lno)
 {
-	size_t i;
+	return diff_get_chunk_range(chunks, lno, lno);
+}
+
+/*
+ * Returns the first chunk intersecting the given inclusive line range. As the
+ * chunks are sorted and disjoint, see diff_emit(), a binary search suffices.
+ */
+const struct diffchunk *
+diff_get_chunk_range(const struct diffchunk *chunks, unsigned int beg,
+    unsigned int end)
+{
+	size_t lo = 0;
+	size_t hi = VECTOR_LENGTH(chunks);
 
-	for (i = 0; i < VECTOR_LENGTH(chunks); i++) {
-		const struct diffchunk *du = &chunks[i];
+	/* Find the first chunk not ending before the range. */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
 
-		if (lno >= du->du_beg && lno <= du->du_end)
-			return du;
+		if (chunks[mid].du_end < beg)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	return NULL;
+	if (lo == VECTOR_LENGTH(chunks) || chunks[lo].du_beg > end)
+		return NULL;
+	return &chunks[lo];
+}
+
+static int
+diff_emit(struct file *fe, const struct diff_callbacks *cb,
+    const struct options *op)
+{
+	/* Chunks are expected to be sorted, unless the diff is malformed. */
+	VECTOR_SORT(fe->fe_diff, diffchunk_cmp);
+
+	if (options_trace_level(op, TRACE_DIFF) > 0) {
+		size_t i;
+
+		for (i = 0; i < VECTOR_LENGTH(fe->fe_diff); i++) {
+			const struct diffchunk *du = &fe->fe_diff[i];
+
+			trace(TRACE_DIFF, op, "%s: %u-%u",
+			    fe->fe_path, du->du_beg, du->du_end);
+		}
+	}
+
+	return cb->file(fe, cb->arg);
 }
 
 static void
@@ -167,19 +176,41 @@ diff_end(struct diffchunk *chunks, unsigned int lno)
 		du->du_end = lno;
 }
 
+static int
+diffchunk_cmp(const struct diffchunk *a, const struct diffchunk *b)
+{
+	if (a->du_beg < b->du_beg)
+		return -1;
+	if (a->du_beg > b->du_beg)
+		return 1;
+	return 0;
+}
+
 static int
 matchpath(const char *str, const char **out, struct arena_scope *s)
 {
-	regmatch_t rm[2];
+	static const char space[] = " \t\n\v\f\r";
 	struct stat sb;
 	const char *buf, *path;
 	size_t len;
 
-	if (regexec(&repath, str, 2, rm, 0))
+	if (strncmp(str, "+++", 3) != 0)
+		return 0;
+	str += 3;
+	len = strspn(str, space);
+	if (len == 0)
+		return 0;
+	buf = &str[len];
+	/*
+	 * The path could contain spaces and is either terminated by the end of
+	 * line or a tab, the latter followed by an optional timestamp.
+	 */
+	len = strcspn(buf, "\t\n");
+	while (len > 0 && isspace((unsigned char)buf[len - 1]))
+		len--;
+	if (len == 0)
 		return 0;
 
-	buf = str + rm[1].rm_so;
-	len = (size_t)(rm[1].rm_eo - rm[1].rm_so);
 	if (strncmp(buf, "b/", 2) == 0) {
 		/* Trim git prefix. */
 		buf = trimprefix(buf, &len);
@@ -200,42 +231,62 @@ matchpath(const char *str, const char **out, struct arena_scope *s)
 	return 1;
 }
 
+/*
+ * Scan the decimal number at the given position, returning zero if absent or
+ * out of range.
+ */
 static unsigned int
-strtou(const char *str)
+scanu(const char **str)
 {
-	unsigned long n;
+	const char *p = *str;
+	unsigned long n = 0;
 
-	errno = 0;
-	n = strtoul(str, NULL, 10);
-	if (n == 0 || n > UINT_MAX || errno != 0)
+	if (!isdigit((unsigned char)*p))
 		return 0;
+	for (; isdigit((unsigned char)*p); p++) {
+		n = n * 10 + (unsigned long)(*p - '0');
+		if (n > UINT_MAX)
+			return 0;
+	}
+	*str = p;
 	return (unsigned int)n;
 }
 
+/*
+ * Match a chunk header on the form "@@ -l[,s] +l[,s] @@", only the new line
+ * range is of interest.
+ */
 static int
 matchchunk(const char *str, unsigned int *sl, unsigned int *el)
 {
-	regmatch_t rm[4];
-	unsigned int lno;
+	const char *p;
 
-	if (regexec(&rechunk, str, 4, rm, 0))
+	if (strncmp(str, "@@", 2) != 0 || str[2] == '\0')
 		return 0;
 
-	lno = strtou(str + rm[1].rm_so);
-	if (lno == 0)
-		return 0;
-	*sl = lno;
+	for (p = &str[3]; (p = strchr(p, '+')) != NULL; p++) {
+		const char *end = &p[1];
+		unsigned int lno;
 
-	if (rm[3].rm_so != -1 && rm[3].rm_eo != -1) {
-		lno = strtou(str + rm[3].rm_so);
+		lno = scanu(&end);
 		if (lno == 0)
-			return 0;
-		*el = (*sl + lno) - 1;
-	} else {
-		*el = *sl;
+			continue;
+		*sl = lno;
+
+		if (end[0] == ',') {
+			end++;
+			lno = scanu(&end);
+			if (lno == 0)
+				return 0;
+			*el = (*sl + lno) - 1;
+		} else {
+			*el = *sl;
+		}
+
+		return end[0] != '\0' && strstr(&end[1], "@@") != NULL;
 	}
 
-	return 1;
+	return 0;
 }
 
 static int
@@ -1,5 +1,8 @@
+#include <stdio.h>	/* FILE */
+
 struct arena;
 struct arena_scope;
+struct file;
 struct files;
 struct options;
 
@@ -8,8 +11,16 @@ struct diffchunk {
 	unsigned int	du_end;
 };
 
+struct diff_callbacks {
+	/* Invoked once all chunks of a file have been parsed. */
+	int	 (*file)(struct file *, void *);
+	void	*arg;
+};
+
 void			 diff_init(void);
-void			 diff_shutdown(void);
-int			 diff_parse(struct files *, struct arena_scope *,
-    struct arena *, const struct options *);
+int			 diff_parse(FILE *, const char *, struct files *,
+    const struct diff_callbacks *, struct arena_scope *, struct arena *,
+    const struct options *);
 const struct diffchunk	*diff_get_chunk(const struct diffchunk *, unsigned int);
+const struct diffchunk	*diff_get_chunk_range(const struct diffchunk *,
+    unsigned int, unsigned int);
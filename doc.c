@@ -139,6 +139,8 @@ struct doc_state {
 	int				 st_mute;
 	/* Flags given to doc_exec(). */
 	unsigned int			 st_flags;
+	/* Statistics given to doc_exec(), not subject to snapshots. */
+	struct doc_exec_stats		*st_exec_stats;
 };
 
 struct doc_state_snapshot {
@@ -305,8 +307,11 @@ static int		doc_is_mute(const struct doc_state *);
 static int		doc_parens_align(const struct doc_state *);
 static int		doc_has_list(const struct doc *);
 static unsigned int	doc_column(struct doc_state *, const char *, size_t);
+static unsigned int	doc_count1(const struct doc *, struct doc_state *,
+    void *);
 static unsigned int	doc_max1(const struct doc *, struct doc_state *,
     void *);
+static unsigned long	doc_cost1(const struct doc *, int, unsigned long *);
 
 static void	doc_state_init(struct doc_state *, struct doc_exec_arg *,
     enum doc_mode);
@@ -388,6 +393,11 @@ static const char	*statestr(const struct doc_state *, unsigned int,
 static unsigned int	count_verbatim_lines(const char *, size_t,
     unsigned int);
 
+/*
+ * Document discarding everything appended to it, see doc_root().
+ */
+static struct doc	doc_sink = {.dc_type = DOC_CONCAT};
+
 void
 doc_exec(struct doc_exec_arg *arg)
 {
@@ -400,6 +410,8 @@ doc_exec(struct doc_exec_arg *arg)
 		doc_trim_lines(dc, &st);
 	doc_diff_exit(dc, &st);
 	doc_trace(dc, &st, "%s: nfits %u", __func__, st.st_stats.nfits);
+	if (arg->stats != NULL)
+		doc_walk(dc, &st, doc_count1, &arg->stats->ndocs);
 }
 
 unsigned int
@@ -415,6 +427,8 @@ doc_width(struct doc_exec_arg *arg)
 void
 doc_remove(struct doc *dc, struct doc *parent)
 {
+	if (parent == &doc_sink)
+		return;
 	assert(doc_has_list(parent));
 	LIST_REMOVE(&parent->dc_list, dc);
 }
@@ -424,6 +438,8 @@ doc_remove_tail(struct doc *parent)
 {
 	struct doc *dc;
 
+	if (parent == &doc_sink)
+		return 0;
 	assert(doc_has_list(parent));
 	dc = LIST_LAST(&parent->dc_list);
 	if (dc == NULL)
@@ -453,6 +469,8 @@ doc_set_align(struct doc *dc, const struct doc_align *align)
 void
 doc_append(struct doc *dc, struct doc *parent)
 {
+	if (parent == &doc_sink)
+		return;
 	if (doc_has_list(parent)) {
 		LIST_INSERT_TAIL(&parent->dc_list, dc);
 	} else {
@@ -464,6 +482,8 @@ doc_append(struct doc *dc, struct doc *parent)
 void
 doc_move_before(struct doc *dc, struct doc *before, struct doc *parent)
 {
+	if (parent == &doc_sink)
+		return;
 	assert(doc_has_list(parent));
 	LIST_REMOVE(&parent->dc_list, dc);
 	LIST_INSERT_BEFORE(before, dc);
@@ -476,11 +496,21 @@ doc_init(struct doc *dc)
 		LIST_INIT(&dc->dc_list);
 }
 
+/*
+ * Allocate a root document. A NULL scope yields a sink, discarding all
+ * documents allocated below it. Used while recognizing constructs without
+ * being interested in the resulting document.
+ */
 struct doc *
 doc_root_impl(struct arena_scope *s, const char *fun, int lno)
 {
 	struct doc *dc;
 
+	if (s == NULL) {
+		doc_init(&doc_sink);
+		return &doc_sink;
+	}
+
 	dc = arena_calloc(s, 1, sizeof(*dc));
 	dc->dc_type = DOC_CONCAT;
 	dc->dc_fun = fun;
@@ -496,6 +526,9 @@ doc_alloc_impl(enum doc_type type, struct doc *parent, int val,
 {
 	struct doc *dc;
 
+	if (parent == &doc_sink)
+		return parent;
+
 	dc = arena_calloc(parent->dc_scope, 1, sizeof(*dc));
 	dc->dc_type = type;
 	dc->dc_fun = fun;
@@ -542,6 +575,9 @@ doc_minimize_impl(const struct doc_minimize *minimizers, size_t nminimizers,
 	struct doc *dc;
 	size_t i;
 
+	if (parent == &doc_sink)
+		return parent;
+
 	dc = doc_alloc_impl(DOC_MINIMIZE, parent, 0, fun, lno);
 	arena_cleanup(dc->dc_scope, doc_minimize_free, dc);
 	if (VECTOR_INIT(dc->dc_minimizers))
@@ -565,6 +601,9 @@ doc_literal_impl(const char *str, struct doc *dc, const char *fun,
 {
 	struct doc *literal;
 
+	if (dc == &doc_sink)
+		return dc;
+
 	literal = doc_alloc_impl(DOC_LITERAL, dc, 0, fun, lno);
 	literal->dc_str = str;
 	literal->dc_len = strlen(str);
@@ -587,6 +626,9 @@ doc_token(struct token *tk, struct doc *dc, enum doc_type type,
 
 	assert(doc_descriptions[type].children.token);
 
+	if (dc == &doc_sink)
+		return dc;
+
 	token = doc_alloc_impl(type, dc, 0, fun, lno);
 	token->dc_tk = tk;
 	token_ref(token->dc_tk);
@@ -613,6 +655,26 @@ doc_max(const struct doc *dc, struct arena *scratch)
 	return max;
 }
 
+/*
+ * Returns an estimate of the work performed by doc_exec() for the given
+ * document, in number of visited documents. Every group is assumed to be
+ * subject to a fit check visiting all its documents and every minimizer
+ * visits all its documents once per evaluated minimizer.
+ */
+unsigned long
+doc_cost(const struct doc *dc)
+{
+	unsigned long ndocs;
+
+	return doc_cost1(dc, 0, &ndocs);
+}
+
+int
+doc_is_sink(const struct doc *dc)
+{
+	return dc == &doc_sink;
+}
+
 void
 doc_annotate(struct doc *dc, const char *suffix)
 {
@@ -907,6 +969,8 @@ doc_exec_minimize_indent(const struct doc *cdc, struct doc_state *st)
 	for (i = 0; i < nminimizers; i++) {
 		memset(&st->st_stats, 0, sizeof(st->st_stats));
 		st->st_minimize.force = -1;
+		if (st->st_exec_stats != NULL)
+			st->st_exec_stats->nminimizers++;
 		st->st_flags &= ~DOC_EXEC_TRACE;
 
 		st->st_minimize.idx = i;
@@ -1086,6 +1150,8 @@ doc_fits(const struct doc *dc, struct doc_state *st)
 
 	if (st->st_flags & DOC_EXEC_TRACE)
 		st->st_stats.nfits++;
+	if (st->st_exec_stats != NULL)
+		st->st_exec_stats->nfits++;
 
 	memcpy(&fst, st, sizeof(fst));
 	/* Should not perform any printing. */
@@ -1342,17 +1408,13 @@ doc_trim_lines(const struct doc *dc, struct doc_state *st)
 static const struct diffchunk *
 doc_diff_find_chunk(const struct doc_state *st, const struct token *tk)
 {
-	unsigned int i, n;
+	unsigned int n;
 
 	n = count_verbatim_lines(tk->tk_str, tk->tk_len, 1);
-	for (i = 0; i < n; i++) {
-		const struct diffchunk *du;
-
-		du = diff_get_chunk(st->st_diff_chunks, tk->tk_lno + i);
-		if (du != NULL)
-			return du;
-	}
-	return NULL;
+	if (n == 0)
+		return NULL;
+	return diff_get_chunk_range(st->st_diff_chunks, tk->tk_lno,
+	    tk->tk_lno + n - 1);
 }
 
 static int
@@ -1803,6 +1865,45 @@ doc_column(struct doc_state *st, const char *str, size_t len)
 	return st->st_col > oldcol ? st->st_col - oldcol : 0;
 }
 
+static unsigned int
+doc_count1(const struct doc *UNUSED(dc), struct doc_state *UNUSED(st),
+    void *arg)
+{
+	unsigned long *ndocs = arg;
+
+	(*ndocs)++;
+	return DOC_WALK_CONTINUE;
+}
+
+static unsigned long
+doc_cost1(const struct doc *dc, int minimize, unsigned long *ndocs)
+{
+	const struct doc_description *desc = &doc_descriptions[dc->dc_type];
+	unsigned long cost = 1;
+	unsigned long n;
+
+	*ndocs = 1;
+	if (desc->children.many) {
+		const struct doc *concat;
+
+		LIST_FOREACH(concat, &dc->dc_list) {
+			cost += doc_cost1(concat, minimize, &n);
+			*ndocs += n;
+		}
+	} else if (desc->children.one) {
+		/* Nested minimizers are fixed by the outermost one. */
+		cost += doc_cost1(dc->dc_doc,
+		    minimize || dc->dc_type == DOC_MINIMIZE, &n);
+		*ndocs += n;
+	}
+
+	if (dc->dc_type == DOC_GROUP)
+		cost += *ndocs;
+	else if (dc->dc_type == DOC_MINIMIZE && !minimize)
+		cost *= VECTOR_LENGTH(dc->dc_minimizers) + 1;
+	return cost;
+}
+
 static unsigned int
 doc_max1(const struct doc *dc, struct doc_state *UNUSED(st), void *arg)
 {
@@ -1834,6 +1935,7 @@ doc_state_init(struct doc_state *st, struct doc_exec_arg *arg,
 	st->st_diff_chunks = arg->diff_chunks;
 	st->st_maxlines = 2;
 	st->st_flags = arg->flags;
+	st->st_exec_stats = arg->stats;
 	st->st_mode = mode;
 	st->st_diff.beg = 1;
 	st->st_minimize.idx = -1;
@@ -25,6 +25,12 @@ enum doc_type {
 	DOC_MAXLINES,
 };
 
+struct doc_exec_stats {
+	unsigned long	ndocs;		/* # documents */
+	unsigned long	nfits;		/* # doc_fits() invocations */
+	unsigned long	nminimizers;	/* # evaluated minimizers */
+};
+
 struct doc_exec_arg {
 	const struct style	*st;
 	struct buffer		*bf;
@@ -32,6 +38,8 @@ struct doc_exec_arg {
 	const struct diffchunk	*diff_chunks;
 	const struct doc	*dc;
 	struct arena		*scratch;
+	/* Optional statistics populated by doc_exec(). */
+	struct doc_exec_stats	*stats;
 	unsigned int		 flags;
 #define DOC_EXEC_DIFF	    0x00000001u
 #define DOC_EXEC_TRACE	    0x00000002u
@@ -131,4 +139,8 @@ struct doc	*doc_token(struct token *, struct doc *, enum doc_type,
 
 int	doc_max(const struct doc *, struct arena *);
 
+unsigned long	doc_cost(const struct doc *);
+
+int	doc_is_sink(const struct doc *);
+
 void	doc_annotate(struct doc *, const char *);
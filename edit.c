@@ -0,0 +1,240 @@
+#include "edit.h"
+
+#include "config.h"
+
+#include <string.h>
+
+#include "libks/arena-vector.h"
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/list.h"
+#include "libks/vector.h"
+
+#include "lexer.h"
+#include "token.h"
+
+/*
+ * Maximum number of bytes of the formatted source code examined while
+ * searching for an anchor which was not found where expected.
+ */
+#define EDIT_SEARCH_MAX	(1 << 12)
+
+/*
+ * Source code of a token, excluding trailing whitespace. The formatter mostly
+ * copies tokens verbatim and only alters the whitespace in between them, the
+ * anchors are therefore expected to be found in order in the formatted source
+ * code.
+ */
+struct edit_anchor {
+	size_t	off;
+	size_t	len;
+};
+
+struct edit_script {
+	VECTOR(struct edit_anchor)	 es_anchors;
+	struct arena_scope		*es_scope;
+};
+
+struct edit_context {
+	const struct edit_script	*es;
+	const char			*src;
+	const char			*dst;
+	size_t				 dstlen;
+	VECTOR(struct edit)		 edits;
+};
+
+static void	anchor_token(struct edit_script *, const struct token *,
+    const struct buffer *);
+static int	anchor_find(const struct edit_context *, size_t, size_t,
+    size_t *);
+static int	anchor_match(const struct edit_context *,
+    const struct edit_anchor *, size_t);
+
+static void	edit_gap(struct edit_context *, size_t, size_t, size_t,
+    size_t);
+
+static size_t	skip_spaces(const char *, size_t, size_t);
+static int	is_space(char);
+
+struct edit_script *
+edit_script_alloc(struct arena_scope *s)
+{
+	struct edit_script *es;
+
+	es = arena_calloc(s, 1, sizeof(*es));
+	ARENA_VECTOR_INIT(s, es->es_anchors, 1 << 8);
+	es->es_scope = s;
+	return es;
+}
+
+/*
+ * Record the position of all tokens in the given source code. Must be called
+ * before the tokens are handed over to the parser as the token list is subject
+ * to mutations.
+ */
+void
+edit_script_anchor(struct edit_script *es, struct lexer *lx,
+    const struct buffer *src)
+{
+	struct token *tk;
+
+	if (!lexer_peek_first(lx, &tk))
+		return;
+	for (; tk != NULL; tk = LIST_NEXT(tk)) {
+		struct token *fix;
+
+		LIST_FOREACH(fix, &tk->tk_prefixes)
+			anchor_token(es, fix, src);
+		anchor_token(es, tk, src);
+		LIST_FOREACH(fix, &tk->tk_suffixes)
+			anchor_token(es, fix, src);
+	}
+}
+
+/*
+ * Returns a minimal list of edits transforming the source code into the
+ * formatted source code, sorted by offset. Only the gaps between the anchors
+ * are compared, anchors not found in the formatted source code are treated as
+ * part of the surrounding gap. The replacements point into the formatted
+ * source code.
+ */
+const struct edit *
+edit_script_exec(struct edit_script *es, const struct buffer *src,
+    const struct buffer *dst)
+{
+	struct edit_context ec = {
+		.es	= es,
+		.src	= buffer_get_ptr(src),
+		.dst	= buffer_get_ptr(dst),
+		.dstlen	= buffer_get_len(dst),
+	};
+	size_t di, i, si;
+
+	ARENA_VECTOR_INIT(es->es_scope, ec.edits, 1 << 4);
+
+	si = di = 0;
+	for (i = 0; i < VECTOR_LENGTH(es->es_anchors); i++) {
+		const struct edit_anchor *an = &es->es_anchors[i];
+		size_t off;
+
+		if (!anchor_find(&ec, i, di, &off))
+			continue;
+		edit_gap(&ec, si, an->off, di, off);
+		si = an->off + an->len;
+		di = off + an->len;
+	}
+	edit_gap(&ec, si, buffer_get_len(src), di, ec.dstlen);
+	return ec.edits;
+}
+
+static void
+anchor_token(struct edit_script *es, const struct token *tk,
+    const struct buffer *src)
+{
+	const char *buf = buffer_get_ptr(src);
+	size_t buflen = buffer_get_len(src);
+	size_t len = tk->tk_len;
+	size_t end = 0;
+
+	if (tk->tk_type == TOKEN_SPACE)
+		return;
+	if (!VECTOR_EMPTY(es->es_anchors)) {
+		const struct edit_anchor *last = VECTOR_LAST(es->es_anchors);
+
+		end = last->off + last->len;
+	}
+	/* Synthetic tokens are not necessarily backed by the source code. */
+	if (tk->tk_off < end || tk->tk_off >= buflen)
+		return;
+	if (len > buflen - tk->tk_off)
+		len = buflen - tk->tk_off;
+	while (len > 0 && is_space(buf[tk->tk_off + len - 1]))
+		len--;
+	if (len == 0)
+		return;
+	*ARENA_VECTOR_ALLOC(es->es_anchors) = (struct edit_anchor){
+	    .off	= tk->tk_off,
+	    .len	= len,
+	};
+}
+
+static int
+anchor_find(const struct edit_context *ec, size_t i, size_t di, size_t *off)
+{
+	const struct edit_anchor *anchors = ec->es->es_anchors;
+	const struct edit_anchor *an = &anchors[i];
+	size_t end, j;
+
+	/* Fast path, only the preceding whitespace differs. */
+	j = skip_spaces(ec->dst, ec->dstlen, di);
+	if (anchor_match(ec, an, j)) {
+		*off = j;
+		return 1;
+	}
+
+	end = ec->dstlen - di > EDIT_SEARCH_MAX ?
+	    di + EDIT_SEARCH_MAX : ec->dstlen;
+	for (j = di; j < end; j++) {
+		if (!anchor_match(ec, an, j))
+			continue;
+		/* Let the next anchor confirm the match. */
+		if (i + 1 < VECTOR_LENGTH(anchors) &&
+		    !anchor_match(ec, &anchors[i + 1],
+		    skip_spaces(ec->dst, ec->dstlen, j + an->len)))
+			continue;
+		*off = j;
+		return 1;
+	}
+	return 0;
+}
+
+static int
+anchor_match(const struct edit_context *ec, const struct edit_anchor *an,
+    size_t off)
+{
+	return off <= ec->dstlen && an->len <= ec->dstlen - off &&
+	    memcmp(&ec->dst[off], &ec->src[an->off], an->len) == 0;
+}
+
+/*
+ * Emit an edit replacing the given source code range with the given formatted
+ * source code range, excluding any common prefix and suffix.
+ */
+static void
+edit_gap(struct edit_context *ec, size_t sbeg, size_t send, size_t dbeg,
+    size_t dend)
+{
+	while (sbeg < send && dbeg < dend && ec->src[sbeg] == ec->dst[dbeg]) {
+		sbeg++;
+		dbeg++;
+	}
+	while (send > sbeg && dend > dbeg &&
+	    ec->src[send - 1] == ec->dst[dend - 1]) {
+		send--;
+		dend--;
+	}
+	if (sbeg == send && dbeg == dend)
+		return;
+
+	*ARENA_VECTOR_ALLOC(ec->edits) = (struct edit){
+	    .ed_off	= sbeg,
+	    .ed_len	= send - sbeg,
+	    .ed_str	= &ec->dst[dbeg],
+	    .ed_strlen	= dend - dbeg,
+	};
+}
+
+static size_t
+skip_spaces(const char *str, size_t len, size_t off)
+{
+	while (off < len && is_space(str[off]))
+		off++;
+	return off;
+}
+
+static int
+is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+	    c == '\v';
+}
@@ -0,0 +1,21 @@
+#include <stddef.h>	/* size_t */
+
+struct arena_scope;
+struct buffer;
+struct lexer;
+
+/*
+ * Replace len bytes at offset off in the source code with the given string.
+ */
+struct edit {
+	size_t		 ed_off;
+	size_t		 ed_len;
+	const char	*ed_str;
+	size_t		 ed_strlen;
+};
+
+struct edit_script	*edit_script_alloc(struct arena_scope *);
+void			 edit_script_anchor(struct edit_script *,
+    struct lexer *, const struct buffer *);
+const struct edit	*edit_script_exec(struct edit_script *,
+    const struct buffer *, const struct buffer *);
@@ -126,6 +126,7 @@ struct expr_state {
 	unsigned int		 es_ncalls;	/* # nested calls */
 	unsigned int		 es_noparens;	/* parens indent disabled */
 	unsigned int		 es_col;	/* ruler column */
+	int			 es_softmax;	/* max weight of soft lines */
 };
 
 static struct expr	*expr_exec1(struct expr_state *, enum expr_pc);
@@ -1202,9 +1203,15 @@ expr_doc_ternary(struct expr *ex, struct expr_state *es, struct doc *dc)
 static struct doc *
 expr_doc_recover(struct expr *ex, struct expr_state *es, struct doc *dc)
 {
+	int softmax;
+
 	if (ex->ex_tk->tk_type == TOKEN_LBRACE)
 		dc = expr_doc_align_disable(ex, es, dc, 0);
 
+	/* Soft lines emitted while recovering are not accounted for. */
+	softmax = doc_max(ex->ex_dc, es->es_arena.scratch);
+	if (softmax > es->es_softmax)
+		es->es_softmax = softmax;
 	doc_append(ex->ex_dc, dc);
 	/*
 	 * The concat document is now responsible for freeing the recover
@@ -1319,8 +1326,8 @@ static struct doc *
 expr_doc_soft_impl(struct expr *ex, struct expr_state *es, struct doc *dc,
     int weight, const char *fun, int lno)
 {
-	struct arena *scratch = es->es_arena.scratch;
 	struct doc *concat, *parent, *softline;
+	int softmax;
 
 	if (es->es_flags & EXPR_EXEC_NOSOFT)
 		return expr_doc(ex, es, dc);
@@ -1329,14 +1336,25 @@ expr_doc_soft_impl(struct expr *ex, struct expr_state *es, struct doc *dc,
 	    doc_alloc_impl(DOC_GROUP, dc, 0, fun, lno), 0, fun, lno);
 	softline = doc_alloc_impl(DOC_SOFTLINE, dc, weight, fun, lno);
 	parent = doc_alloc(DOC_CONCAT, dc);
+	/*
+	 * The weight of nested soft lines is accumulated while emitting the
+	 * expression, favored over walking the document as that would render
+	 * deeply nested expressions quadratic.
+	 */
+	softmax = es->es_softmax;
+	es->es_softmax = 0;
 	concat = expr_doc(ex, es, parent);
 	/*
 	 * Honor the soft line with the highest weight. Using greater than or
 	 * equal is of importance as we want to maximize column utilisation,
 	 * effectively favoring nested soft line(s).
 	 */
-	if (weight < SOFT_MAX && doc_max(parent, scratch) >= weight)
+	if (weight < SOFT_MAX && es->es_softmax >= weight)
 		doc_remove(softline, dc);
+	else if (weight > es->es_softmax)
+		es->es_softmax = weight;
+	if (softmax > es->es_softmax)
+		es->es_softmax = softmax;
 
 	return concat;
 }
@@ -1,5 +1,6 @@
 struct arena_scope;
 struct buffer;
+struct style;
 
 struct files {
 	struct file	*fs_vc;			/* VECTOR(struct file) */
@@ -7,6 +8,7 @@ struct files {
 
 struct file {
 	struct diffchunk	*fe_diff;	/* VECTOR(struct diffchunk) */
+	struct style		*fe_style;
 	char			*fe_path;
 	int			 fe_fd;
 };
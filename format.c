@@ -0,0 +1,69 @@
+#include "format.h"
+
+#include "config.h"
+
+#include "libks/arena.h"
+
+#include "arenas.h"
+#include "clang.h"
+#include "edit.h"
+#include "lexer.h"
+#include "options.h"
+#include "parser.h"
+#include "timing.h"
+#include "trace-types.h"
+
+/*
+ * Format the given source code into the destination buffer. Shared by the
+ * command line utility and the library, see libknfmt.h.
+ */
+int
+format(const struct format_arg *arg)
+{
+	const struct options *op = arg->options;
+	struct arenas *arena = arg->arena;
+	struct timing *ti = arg->timing;
+	struct clang *clang;
+	struct lexer *lx;
+	struct parser *pr;
+	int error;
+
+	arena_scope(arena->eternal, eternal_scope);
+
+	timing_enter(ti, TIMING_LEXER);
+	clang = clang_alloc(arg->style, arg->simple, arena, arg->diff_chunks,
+	    op, &eternal_scope);
+	lx = lexer_tokenize(&(const struct lexer_arg){
+	    .path		= arg->path,
+	    .bf			= arg->src,
+	    .op			= op,
+	    .error_flush	= options_trace_level(op, TRACE_LEXER) > 0,
+	    .arena		= {
+		.eternal_scope	= &eternal_scope,
+		.scratch	= arena->scratch,
+	    },
+	    .callbacks		= clang_lexer_callbacks(clang),
+	});
+	timing_leave(ti, TIMING_LEXER);
+	if (lx == NULL)
+		return 1;
+	if (arg->edits != NULL)
+		edit_script_anchor(arg->edits, lx, arg->src);
+	if (options_trace_level(op, TRACE_TOKEN) > 0)
+		lexer_dump(lx);
+
+	pr = parser_alloc(&(struct parser_arg){
+	    .lexer	= lx,
+	    .options	= op,
+	    .style	= arg->style,
+	    .simple	= arg->simple,
+	    .clang	= clang,
+	    .arena	= arena,
+	    .timing	= ti,
+	    .typedefs	= arg->typedefs,
+	}, &eternal_scope);
+	error = parser_exec(pr, arg->diff_chunks, arg->dst);
+	timing_count(ti, TIMING_TOKENS, lexer_get_stats(lx)->ntokens);
+	timing_count(ti, TIMING_PEEKS, lexer_get_stats(lx)->npeeks);
+	return error;
+}
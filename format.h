@@ -0,0 +1,29 @@
+struct arenas;
+struct buffer;
+struct diffchunk;
+struct edit_script;
+struct options;
+struct simple;
+struct style;
+struct timing;
+struct typedef_index;
+
+struct format_arg {
+	const char		*path;
+	const struct buffer	*src;
+	struct buffer		*dst;
+	/* Changed lines, only honored in diff mode. */
+	const struct diffchunk	*diff_chunks;
+	const struct style	*style;
+	struct simple		*simple;
+	const struct options	*options;
+	struct arenas		*arena;
+	/* Optional per phase timing, see timing_alloc(). */
+	struct timing		*timing;
+	/* Optional edit script anchored at the source tokens. */
+	struct edit_script	*edits;
+	/* Optional typedef names declared in headers. */
+	struct typedef_index	*typedefs;
+};
+
+int	format(const struct format_arg *);
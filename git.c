@@ -0,0 +1,257 @@
+#include "git.h"
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/compiler.h"
+
+#include "util.h"
+
+/*
+ * Interface to the Git repository of the current directory, used to format
+ * staged changes. The staged contents of all files are read from memory
+ * through a single long-lived git-cat-file(1) process.
+ */
+struct git {
+	struct git_process {
+		pid_t	 pid;
+		/* Standard input of the process, NULL if not used. */
+		FILE	*in;
+		FILE	*out;
+	} cat, diff;
+};
+
+static void	git_spawn(struct git_process *, const char *const *, int);
+static int	git_wait(struct git_process *);
+static void	git_free(void *);
+
+/*
+ * Returns NULL if the current directory is not part of a Git repository.
+ */
+struct git *
+git_alloc(struct arena_scope *eternal_scope)
+{
+	static const char *const argv[] = {
+		"git", "cat-file", "--batch", NULL,
+	};
+	struct git *gt;
+	char *line = NULL;
+	size_t linesiz = 0;
+	int error;
+
+	gt = arena_calloc(eternal_scope, 1, sizeof(*gt));
+	gt->cat.pid = -1;
+	gt->diff.pid = -1;
+	arena_cleanup(eternal_scope, git_free, gt);
+	/* Let writes to an exited process fail instead. */
+	signal(SIGPIPE, SIG_IGN);
+	git_spawn(&gt->cat, argv, 1);
+
+	/*
+	 * An empty request is always answered unless git-cat-file(1) refuses
+	 * to run outside of a repository, in which case git-diff(1) would
+	 * silently fallback to comparing files.
+	 */
+	error = fputc('\n', gt->cat.in) == EOF || fflush(gt->cat.in) == EOF ||
+	    getline(&line, &linesiz, gt->cat.out) == -1;
+	free(line);
+	if (error) {
+		(void)git_wait(&gt->cat);
+		return NULL;
+	}
+	return gt;
+}
+
+/*
+ * Returns a stream of the staged changes as a unified diff without context,
+ * optionally limited to the given NULL terminated list of paths. Paths are
+ * relative to the current directory.
+ */
+FILE *
+git_diff_staged(struct git *gt, char **pathspecs)
+{
+	static const char *const args[] = {
+		"git", "-c", "core.quotePath=off", "diff", "--cached",
+		"--diff-filter=d", "--no-color", "--no-ext-diff", "--relative",
+		"-U0", "--",
+	};
+	const char **argv;
+	size_t i, n;
+
+	for (n = 0; pathspecs[n] != NULL; n++)
+		continue;
+	argv = calloc(countof(args) + n + 1, sizeof(*argv));
+	if (argv == NULL)
+		err(1, NULL);
+	for (i = 0; i < countof(args); i++)
+		argv[i] = args[i];
+	for (i = 0; i < n; i++)
+		argv[countof(args) + i] = pathspecs[i];
+	git_spawn(&gt->diff, argv, 0);
+	free(argv);
+	return gt->diff.out;
+}
+
+/*
+ * Wait for the diff to finish, returns non-zero if unsuccessful.
+ */
+int
+git_diff_wait(struct git *gt)
+{
+	return git_wait(&gt->diff);
+}
+
+/*
+ * Read the staged contents of the given path, relative to the current
+ * directory.
+ */
+int
+git_read_staged(struct git *gt, const char *path, struct buffer *bf)
+{
+	char *line = NULL;
+	size_t linesiz = 0;
+	size_t size;
+	int error = 1;
+	int n;
+
+	if (strchr(path, '\n') != NULL) {
+		warnx("%s: invalid path", path);
+		return 1;
+	}
+	if (fprintf(gt->cat.in, ":./%s\n", path) < 0 ||
+	    fflush(gt->cat.in) == EOF) {
+		warn("git cat-file");
+		return 1;
+	}
+
+	/* Response on the form "<object> <type> <size>". */
+	if (getline(&line, &linesiz, gt->cat.out) == -1) {
+		warnx("git cat-file: unexpected end of output");
+		goto out;
+	}
+	n = -1;
+	if (sscanf(line, "%*s blob %zu%n", &size, &n) < 1 || n == -1 ||
+	    line[n] != '\n') {
+		warnx("%s: not staged", path);
+		goto out;
+	}
+	if (read_buffer(gt->cat.out, bf, size) ||
+	    fgetc(gt->cat.out) != '\n') {
+		warnx("git cat-file: short output");
+		goto out;
+	}
+	error = 0;
+
+out:
+	free(line);
+	return error;
+}
+
+static void
+git_spawn(struct git_process *gp, const char *const *argv, int input)
+{
+	int in[2] = {-1, -1};
+	int out[2];
+	pid_t pid;
+
+	/* NOLINTNEXTLINE(android-cloexec-pipe) */
+	if ((input && pipe(in) == -1) || pipe(out) == -1)
+		err(1, "pipe");
+	/* Prevent our ends from leaking into subsequent processes. */
+	if ((input && fcntl(in[1], F_SETFD, FD_CLOEXEC) == -1) ||
+	    fcntl(out[0], F_SETFD, FD_CLOEXEC) == -1)
+		err(1, "fcntl");
+
+	pid = fork();
+	if (pid == -1)
+		err(1, "fork");
+	if (pid == 0) {
+		char **args;
+		size_t i, n;
+
+		if ((input && dup2(in[0], 0) == -1) || dup2(out[1], 1) == -1)
+			err(1, "dup2");
+		/* Arguments must be mutable according to execvp(3). */
+		for (n = 0; argv[n] != NULL; n++)
+			continue;
+		args = calloc(n + 1, sizeof(*args));
+		if (args == NULL)
+			err(1, NULL);
+		for (i = 0; i < n; i++) {
+			args[i] = strdup(argv[i]);
+			if (args[i] == NULL)
+				err(1, NULL);
+		}
+		execvp(args[0], args);
+		warn("%s", args[0]);
+		_exit(1);
+	}
+
+	if (input) {
+		close(in[0]);
+		gp->in = fdopen(in[1], "w");
+		if (gp->in == NULL)
+			err(1, NULL);
+	}
+	close(out[1]);
+	gp->out = fdopen(out[0], "r");
+	if (gp->out == NULL)
+		err(1, NULL);
+	gp->pid = pid;
+}
+
+/*
+ * Close the streams and wait for the process to exit, returns non-zero if
+ * unsuccessful.
+ */
+static int
+git_wait(struct git_process *gp)
+{
+	int status;
+
+	if (gp->in != NULL) {
+		fclose(gp->in);
+		gp->in = NULL;
+	}
+	if (gp->out != NULL) {
+		fclose(gp->out);
+		gp->out = NULL;
+	}
+	if (gp->pid == -1)
+		return 0;
+
+	while (waitpid(gp->pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			warn("waitpid");
+			return 1;
+		}
+	}
+	gp->pid = -1;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		warnx("git: exited unsuccessfully");
+		return 1;
+	}
+	return 0;
+}
+
+static void
+git_free(void *arg)
+{
+	struct git *gt = arg;
+
+	(void)git_wait(&gt->diff);
+	(void)git_wait(&gt->cat);
+}
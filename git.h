@@ -0,0 +1,9 @@
+#include <stdio.h>	/* FILE */
+
+struct arena_scope;
+struct buffer;
+
+struct git	*git_alloc(struct arena_scope *);
+FILE		*git_diff_staged(struct git *, char **);
+int		 git_diff_wait(struct git *);
+int		 git_read_staged(struct git *, const char *, struct buffer *);
@@ -0,0 +1,460 @@
+#include "json.h"
+
+#include "config.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include "libks/arena.h"
+#include "libks/buffer.h"
+
+/* Maximum nesting of arrays and objects. */
+#define JSON_DEPTH_MAX	64
+
+/*
+ * Minimal JSON parser, just enough to handle the messages of the Language
+ * Server Protocol. All values are allocated using the given arena scope.
+ */
+struct json_parser {
+	const char		*ptr;
+	const char		*end;
+	struct arena_scope	*s;
+	unsigned int		 depth;
+};
+
+static struct json	*parse_value(struct json_parser *);
+static struct json	*parse_array(struct json_parser *, struct json *);
+static struct json	*parse_object(struct json_parser *, struct json *);
+static int		 parse_string(struct json_parser *, const char **,
+    size_t *);
+static int		 parse_number(struct json_parser *);
+static int		 parse_literal(struct json_parser *, const char *);
+static int		 parse_hex(struct json_parser *, unsigned int *);
+
+static void	skip_spaces(struct json_parser *);
+static size_t	utf8_encode(unsigned int, char *);
+
+/*
+ * Parse the given JSON document. Returns NULL on error.
+ */
+struct json *
+json_parse(const char *str, size_t len, struct arena_scope *s)
+{
+	struct json_parser jp = {
+		.ptr	= str,
+		.end	= &str[len],
+		.s	= s,
+	};
+	struct json *js;
+
+	js = parse_value(&jp);
+	if (js == NULL)
+		return NULL;
+	skip_spaces(&jp);
+	if (jp.ptr != jp.end)
+		return NULL;
+	return js;
+}
+
+/*
+ * Returns the member of the given object with the given name, or NULL if not
+ * found.
+ */
+const struct json *
+json_get(const struct json *js, const char *key)
+{
+	const struct json *member;
+
+	if (js == NULL || js->js_type != JSON_OBJECT)
+		return NULL;
+	for (member = js->js_child; member != NULL; member = member->js_next) {
+		if (strcmp(member->js_key, key) == 0)
+			return member;
+	}
+	return NULL;
+}
+
+const char *
+json_get_string(const struct json *js, const char *key, size_t *len)
+{
+	const struct json *member;
+
+	member = json_get(js, key);
+	if (member == NULL || member->js_type != JSON_STRING)
+		return NULL;
+	if (len != NULL)
+		*len = member->js_len;
+	return member->js_str;
+}
+
+int
+json_get_uint(const struct json *js, const char *key, unsigned int *res)
+{
+	const struct json *member;
+	unsigned long val = 0;
+	size_t i;
+
+	member = json_get(js, key);
+	if (member == NULL || member->js_type != JSON_NUMBER)
+		return 1;
+	for (i = 0; i < member->js_rawlen; i++) {
+		unsigned char c = (unsigned char)member->js_raw[i];
+
+		if (c < '0' || c > '9')
+			return 1;
+		val = val * 10 + (unsigned long)(c - '0');
+		if (val > UINT_MAX)
+			return 1;
+	}
+	*res = (unsigned int)val;
+	return 0;
+}
+
+void
+json_print_string(struct buffer *bf, const char *str, size_t len)
+{
+	size_t i;
+
+	buffer_putc(bf, '"');
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)str[i];
+
+		if (c == '"' || c == '\\') {
+			buffer_putc(bf, '\\');
+			buffer_putc(bf, (char)c);
+		} else if (c == '\n') {
+			buffer_puts(bf, "\\n", 2);
+		} else if (c == '\t') {
+			buffer_puts(bf, "\\t", 2);
+		} else if (c < 0x20) {
+			buffer_printf(bf, "\\u%04x", c);
+		} else {
+			buffer_putc(bf, (char)c);
+		}
+	}
+	buffer_putc(bf, '"');
+}
+
+static struct json *
+parse_value(struct json_parser *jp)
+{
+	struct json *js;
+	const char *beg;
+	int error = 0;
+
+	skip_spaces(jp);
+	if (jp->ptr == jp->end)
+		return NULL;
+
+	js = arena_calloc(jp->s, 1, sizeof(*js));
+	beg = jp->ptr;
+	switch (*jp->ptr) {
+	case '[':
+		if (parse_array(jp, js) == NULL)
+			return NULL;
+		break;
+	case '{':
+		if (parse_object(jp, js) == NULL)
+			return NULL;
+		break;
+	case '"':
+		js->js_type = JSON_STRING;
+		error = parse_string(jp, &js->js_str, &js->js_len);
+		break;
+	case 't':
+		js->js_type = JSON_BOOLEAN;
+		error = parse_literal(jp, "true");
+		break;
+	case 'f':
+		js->js_type = JSON_BOOLEAN;
+		error = parse_literal(jp, "false");
+		break;
+	case 'n':
+		js->js_type = JSON_NULL;
+		error = parse_literal(jp, "null");
+		break;
+	default:
+		js->js_type = JSON_NUMBER;
+		error = parse_number(jp);
+		break;
+	}
+	if (error)
+		return NULL;
+	js->js_raw = beg;
+	js->js_rawlen = (size_t)(jp->ptr - beg);
+	return js;
+}
+
+static struct json *
+parse_array(struct json_parser *jp, struct json *js)
+{
+	struct json **last = &js->js_child;
+
+	if (++jp->depth > JSON_DEPTH_MAX)
+		return NULL;
+	js->js_type = JSON_ARRAY;
+	jp->ptr++;
+	skip_spaces(jp);
+	if (jp->ptr < jp->end && *jp->ptr == ']') {
+		jp->ptr++;
+		jp->depth--;
+		return js;
+	}
+	for (;;) {
+		struct json *el;
+
+		el = parse_value(jp);
+		if (el == NULL)
+			return NULL;
+		*last = el;
+		last = &el->js_next;
+
+		skip_spaces(jp);
+		if (jp->ptr == jp->end)
+			return NULL;
+		if (*jp->ptr == ']')
+			break;
+		if (*jp->ptr != ',')
+			return NULL;
+		jp->ptr++;
+	}
+	jp->ptr++;
+	jp->depth--;
+	return js;
+}
+
+static struct json *
+parse_object(struct json_parser *jp, struct json *js)
+{
+	struct json **last = &js->js_child;
+
+	if (++jp->depth > JSON_DEPTH_MAX)
+		return NULL;
+	js->js_type = JSON_OBJECT;
+	jp->ptr++;
+	skip_spaces(jp);
+	if (jp->ptr < jp->end && *jp->ptr == '}') {
+		jp->ptr++;
+		jp->depth--;
+		return js;
+	}
+	for (;;) {
+		struct json *member;
+		const char *key;
+		size_t keylen;
+
+		skip_spaces(jp);
+		if (jp->ptr == jp->end || *jp->ptr != '"')
+			return NULL;
+		if (parse_string(jp, &key, &keylen))
+			return NULL;
+		skip_spaces(jp);
+		if (jp->ptr == jp->end || *jp->ptr != ':')
+			return NULL;
+		jp->ptr++;
+		member = parse_value(jp);
+		if (member == NULL)
+			return NULL;
+		member->js_key = key;
+		*last = member;
+		last = &member->js_next;
+
+		skip_spaces(jp);
+		if (jp->ptr == jp->end)
+			return NULL;
+		if (*jp->ptr == '}')
+			break;
+		if (*jp->ptr != ',')
+			return NULL;
+		jp->ptr++;
+	}
+	jp->ptr++;
+	jp->depth--;
+	return js;
+}
+
+/*
+ * Parse and decode string, the decoded string is never longer than its
+ * verbatim representation.
+ */
+static int
+parse_string(struct json_parser *jp, const char **res, size_t *reslen)
+{
+	char *dst;
+	const char *p;
+	size_t len = 0;
+
+	jp->ptr++;
+	for (p = jp->ptr; p < jp->end && *p != '"'; p++) {
+		if (*p == '\\')
+			p++;
+	}
+	if (p >= jp->end)
+		return 1;
+	dst = arena_malloc(jp->s, (size_t)(p - jp->ptr) + 1);
+
+	while (*jp->ptr != '"') {
+		unsigned char c = (unsigned char)*jp->ptr++;
+		unsigned int cp, lo;
+
+		if (c < 0x20)
+			return 1;
+		if (c != '\\') {
+			dst[len++] = (char)c;
+			continue;
+		}
+
+		switch (*jp->ptr++) {
+		case '"':
+			dst[len++] = '"';
+			break;
+		case '\\':
+			dst[len++] = '\\';
+			break;
+		case '/':
+			dst[len++] = '/';
+			break;
+		case 'b':
+			dst[len++] = '\b';
+			break;
+		case 'f':
+			dst[len++] = '\f';
+			break;
+		case 'n':
+			dst[len++] = '\n';
+			break;
+		case 'r':
+			dst[len++] = '\r';
+			break;
+		case 't':
+			dst[len++] = '\t';
+			break;
+		case 'u':
+			if (parse_hex(jp, &cp))
+				return 1;
+			/* Surrogate pair. */
+			if (cp >= 0xd800 && cp <= 0xdbff) {
+				if (jp->end - jp->ptr < 2 ||
+				    jp->ptr[0] != '\\' || jp->ptr[1] != 'u')
+					return 1;
+				jp->ptr += 2;
+				if (parse_hex(jp, &lo) || lo < 0xdc00 ||
+				    lo > 0xdfff)
+					return 1;
+				cp = 0x10000 + ((cp - 0xd800) << 10) +
+				    (lo - 0xdc00);
+			}
+			len += utf8_encode(cp, &dst[len]);
+			break;
+		default:
+			return 1;
+		}
+	}
+	jp->ptr++;
+	dst[len] = '\0';
+	*res = dst;
+	*reslen = len;
+	return 0;
+}
+
+static int
+parse_number(struct json_parser *jp)
+{
+	const char *beg;
+
+	if (jp->ptr < jp->end && *jp->ptr == '-')
+		jp->ptr++;
+	beg = jp->ptr;
+	while (jp->ptr < jp->end && *jp->ptr >= '0' && *jp->ptr <= '9')
+		jp->ptr++;
+	if (jp->ptr == beg)
+		return 1;
+	if (jp->ptr < jp->end && *jp->ptr == '.') {
+		beg = ++jp->ptr;
+		while (jp->ptr < jp->end && *jp->ptr >= '0' && *jp->ptr <= '9')
+			jp->ptr++;
+		if (jp->ptr == beg)
+			return 1;
+	}
+	if (jp->ptr < jp->end && (*jp->ptr == 'e' || *jp->ptr == 'E')) {
+		jp->ptr++;
+		if (jp->ptr < jp->end && (*jp->ptr == '+' || *jp->ptr == '-'))
+			jp->ptr++;
+		beg = jp->ptr;
+		while (jp->ptr < jp->end && *jp->ptr >= '0' && *jp->ptr <= '9')
+			jp->ptr++;
+		if (jp->ptr == beg)
+			return 1;
+	}
+	return 0;
+}
+
+static int
+parse_literal(struct json_parser *jp, const char *literal)
+{
+	size_t len;
+
+	len = strlen(literal);
+	if ((size_t)(jp->end - jp->ptr) < len ||
+	    strncmp(jp->ptr, literal, len) != 0)
+		return 1;
+	jp->ptr += len;
+	return 0;
+}
+
+static int
+parse_hex(struct json_parser *jp, unsigned int *res)
+{
+	int i;
+
+	if (jp->end - jp->ptr < 4)
+		return 1;
+	*res = 0;
+	for (i = 0; i < 4; i++) {
+		unsigned char c = (unsigned char)*jp->ptr++;
+
+		*res <<= 4;
+		if (c >= '0' && c <= '9')
+			*res |= (unsigned int)(c - '0');
+		else if (c >= 'a' && c <= 'f')
+			*res |= (unsigned int)(c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			*res |= (unsigned int)(c - 'A' + 10);
+		else
+			return 1;
+	}
+	return 0;
+}
+
+static void
+skip_spaces(struct json_parser *jp)
+{
+	while (jp->ptr < jp->end && (*jp->ptr == ' ' || *jp->ptr == '\t' ||
+	    *jp->ptr == '\n' || *jp->ptr == '\r'))
+		jp->ptr++;
+}
+
+static size_t
+utf8_encode(unsigned int cp, char *dst)
+{
+	if (cp < 0x80) {
+		dst[0] = (char)cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		dst[0] = (char)(0xc0 | (cp >> 6));
+		dst[1] = (char)(0x80 | (cp & 0x3f));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		dst[0] = (char)(0xe0 | (cp >> 12));
+		dst[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		dst[2] = (char)(0x80 | (cp & 0x3f));
+		return 3;
+	}
+	dst[0] = (char)(0xf0 | (cp >> 18));
+	dst[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+	dst[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+	dst[3] = (char)(0x80 | (cp & 0x3f));
+	return 4;
+}
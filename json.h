@@ -0,0 +1,38 @@
+#include <stddef.h>	/* size_t */
+
+struct arena_scope;
+struct buffer;
+
+enum json_type {
+	JSON_NULL,
+	JSON_BOOLEAN,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT,
+};
+
+struct json {
+	enum json_type	 js_type;
+	/* Verbatim representation of the value. */
+	const char	*js_raw;
+	size_t		 js_rawlen;
+	/* Decoded string, only present for strings. */
+	const char	*js_str;
+	size_t		 js_len;
+	/* Name of object member. */
+	const char	*js_key;
+	/* First element of array or object. */
+	struct json	*js_child;
+	struct json	*js_next;
+};
+
+struct json	*json_parse(const char *, size_t, struct arena_scope *);
+
+const struct json	*json_get(const struct json *, const char *);
+const char		*json_get_string(const struct json *, const char *,
+    size_t *);
+int			 json_get_uint(const struct json *, const char *,
+    unsigned int *);
+
+void	json_print_string(struct buffer *, const char *, size_t);
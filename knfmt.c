@@ -1,8 +1,10 @@
 #include "config.h"
 
 #include <err.h>
+#include <limits.h>	/* PATH_MAX */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "libks/arena-buffer.h"
@@ -15,32 +17,71 @@
 #include "arenas.h"
 #include "clang.h"
 #include "diff.h"
+#include "edit.h"
 #include "expr.h"
 #include "file.h"
-#include "lexer.h"
+#include "format.h"
+#include "git.h"
+#include "json.h"
+#include "lsp.h"
 #include "options.h"
-#include "parser.h"
+#include "server.h"
 #include "simple.h"
+#include "style-cache.h"
 #include "style.h"
+#include "timing.h"
 #include "trace-types.h"
+#include "typedef-index.h"
+
+/* Maximum number of files edited in place awaiting a flush, see -F batch. */
+#define SYNC_BATCH_MAX	64
+
+/* How in place edits are made durable, see -F. */
+enum sync_mode {
+	SYNC_NONE,
+	SYNC_FILE,
+	SYNC_BATCH,
+};
 
 struct main_context {
-	struct options	 options;
-	struct style	*style;
-	struct simple	*simple;
-	struct buffer	*src;
-	struct buffer	*dst;
-	struct arenas	 arena;
+	struct options		 options;
+	struct style_cache	*styles;
+	struct simple		*simple;
+	struct timing		*timing;
+	struct server_client	*remote;
+	struct edit_script	*edits;
+	struct git		*git;
+	struct typedef_index	*typedefs;
+	struct buffer		*src;
+	struct buffer		*dst;
+	struct arenas		 arena;
+	enum sync_mode		 sync;
+	/* Files edited in place awaiting a flush. */
+	struct {
+		const char	*path;
+		int		 fd;
+	} syncs[SYNC_BATCH_MAX];
+	size_t			 nsyncs;
 };
 
 static void	usage(void) __attribute__((noreturn));
-
-static int	filelist(int, char **, struct files *, struct arena_scope *,
-    struct arena *, const struct options *);
+static int	syncparse(const char *, enum sync_mode *);
+static int	syncbatch(struct main_context *);
+static int	typedefsinit(struct main_context *, const char *, int, char **,
+    int, struct arena_scope *);
+
+static void	filelist(int, char **, struct files *, struct arena_scope *);
+static int	filediffparse(struct file *, void *);
+static int	filehandle(struct main_context *, struct file *);
 static int	fileformat(struct main_context *, struct file *);
+static int	fileremote(struct main_context *, const struct file *);
 static int	filediff(struct main_context *, const struct file *);
+static int	fileedit(struct main_context *, const struct file *);
 static int	filewrite(struct main_context *, const struct file *);
 static int	fileprint(const struct buffer *);
+static int	filestdin(const struct file *);
+
+static const char	stdin_path[] = "/dev/stdin";
 
 int
 main(int argc, char *argv[])
@@ -48,17 +89,36 @@ main(int argc, char *argv[])
 	struct main_context c = {0};
 	struct files files = {0};
 	const char *clang_format = NULL;
+	const char *remote = NULL;
+	const char *serve = NULL;
+	const char *style_cache = NULL;
+	const char *typedefs = NULL;
 	size_t i;
+	unsigned int timing_flags = 0;
+	int batch = 0;
 	int error = 0;
+	int lsp = 0;
+	int staged = 0;
 	int ch;
 
-	if (pledge("stdio rpath wpath cpath fattr chown proc exec", NULL) == -1)
+	if (pledge("stdio rpath wpath cpath fattr chown unix proc exec",
+	    NULL) == -1)
 		err(1, "pledge");
 
 	options_init(&c.options);
 
-	while ((ch = getopt(argc, argv, "c:Ddist:")) != -1) {
+	while ((ch = getopt(argc, argv, "B:bC:c:DdEF:GiLR:S:sT:t:")) != -1) {
 		switch (ch) {
+		case 'B':
+			if (options_budget_parse(&c.options, optarg))
+				return 1;
+			break;
+		case 'b':
+			batch = 1;
+			break;
+		case 'C':
+			style_cache = optarg;
+			break;
 		case 'c':
 			clang_format = optarg;
 			break;
@@ -68,12 +128,34 @@ main(int argc, char *argv[])
 		case 'd':
 			c.options.diff = 1;
 			break;
+		case 'E':
+			c.options.edit = 1;
+			break;
+		case 'F':
+			if (syncparse(optarg, &c.sync))
+				return 1;
+			break;
+		case 'G':
+			staged = 1;
+			break;
 		case 'i':
 			c.options.inplace = 1;
 			break;
+		case 'L':
+			lsp = 1;
+			break;
+		case 'R':
+			remote = optarg;
+			break;
+		case 'S':
+			serve = optarg;
+			break;
 		case 's':
 			c.options.simple = 1;
 			break;
+		case 'T':
+			typedefs = optarg;
+			break;
 		case 't':
 			if (options_trace_parse(&c.options, optarg))
 				return 1;
@@ -87,6 +169,27 @@ main(int argc, char *argv[])
 	if ((c.options.diffparse && argc > 0) ||
 	    (!c.options.diffparse && c.options.inplace && argc == 0))
 		usage();
+	if (c.options.edit && (c.options.diff || c.options.inplace))
+		usage();
+	if (c.sync != SYNC_NONE && !c.options.inplace)
+		usage();
+	if (staged && (c.options.diffparse || c.options.inplace || batch ||
+	    lsp || remote != NULL || serve != NULL))
+		usage();
+	if (serve != NULL && (argc > 0 || remote != NULL || c.options.diff ||
+	    c.options.diffparse || c.options.edit || c.options.inplace))
+		usage();
+	if (remote != NULL && (argc == 0 || c.options.diffparse ||
+	    c.options.edit || typedefs != NULL))
+		usage();
+	if (lsp && (argc > 0 || remote != NULL || serve != NULL ||
+	    c.options.diff || c.options.diffparse || c.options.edit ||
+	    c.options.inplace))
+		usage();
+	if (batch && (argc > 0 || lsp || remote != NULL || serve != NULL ||
+	    c.options.diff || c.options.diffparse || c.options.edit ||
+	    c.options.inplace))
+		usage();
 
 	clang_init();
 	expr_init();
@@ -99,14 +202,141 @@ main(int argc, char *argv[])
 
 	arenas_init(&c.arena);
 	arena_scope(c.arena.eternal, eternal_scope);
-	arena_scope(c.arena.buffer, buffer_scope);
-	c.style = style_parse(clang_format, &eternal_scope, c.arena.scratch,
-	    &c.options);
-	if (c.style == NULL) {
+	c.styles = style_cache_alloc(clang_format, style_cache, &eternal_scope,
+	    c.arena.scratch, &c.options);
+	if (c.styles == NULL) {
+		error = 1;
+		goto out;
+	}
+
+	c.simple = simple_alloc(&eternal_scope, &c.options);
+	if (options_trace_level(&c.options, TRACE_TIMING) > 0)
+		timing_flags |= TIMING_CLOCK;
+	if (options_trace_level(&c.options, TRACE_MEMORY) > 0)
+		timing_flags |= TIMING_MEMORY;
+	if (timing_flags != 0)
+		c.timing = timing_alloc(&eternal_scope, &c.arena, timing_flags);
+
+	if (typedefs != NULL && typedefsinit(&c, typedefs, argc, argv,
+	    staged, &eternal_scope)) {
 		error = 1;
 		goto out;
 	}
 
+	if (serve != NULL) {
+		if (pledge("stdio rpath wpath cpath unix proc exec",
+		    NULL) == -1)
+			err(1, "pledge");
+		/*
+		 * Resolve the style for the current directory upfront, shared
+		 * by all workers.
+		 */
+		(void)style_cache_lookup(c.styles, NULL);
+		if (server_run(&(const struct server_arg){
+		    .path	= serve,
+		    .styles	= c.styles,
+		    .simple	= c.simple,
+		    .options	= &c.options,
+		    .arena	= &c.arena,
+		    .typedefs	= c.typedefs,
+		}))
+			error = 1;
+		goto out;
+	}
+	if (batch) {
+		if (pledge("stdio rpath wpath cpath proc exec", NULL) == -1)
+			err(1, "pledge");
+		if (server_batch(&(const struct server_arg){
+		    .styles	= c.styles,
+		    .simple	= c.simple,
+		    .options	= &c.options,
+		    .arena	= &c.arena,
+		    .typedefs	= c.typedefs,
+		}))
+			error = 1;
+		goto out;
+	}
+	if (lsp) {
+		if (pledge("stdio rpath proc exec", NULL) == -1)
+			err(1, "pledge");
+		if (lsp_run(&(const struct lsp_arg){
+		    .styles	= c.styles,
+		    .simple	= c.simple,
+		    .options	= &c.options,
+		    .arena	= &c.arena,
+		    .typedefs	= c.typedefs,
+		}))
+			error = 1;
+		goto out;
+	}
+	if (remote != NULL) {
+		c.remote = server_client_alloc(remote, &eternal_scope);
+		if (c.remote == NULL) {
+			error = 1;
+			goto out;
+		}
+	}
+
+	if (c.options.diffparse || staged) {
+		FILE *fp = stdin;
+		const char *name = stdin_path;
+
+		/*
+		 * Staged changes are read from the diff of the index, along
+		 * with the staged contents of each file.
+		 */
+		if (staged) {
+			c.git = git_alloc(&eternal_scope);
+			if (c.git == NULL) {
+				error = 1;
+				goto out;
+			}
+			fp = git_diff_staged(c.git, argv);
+			name = "git diff";
+			c.options.diffparse = 1;
+		}
+
+		/*
+		 * Files are formatted as soon as they are found in the diff,
+		 * the style must therefore be resolved on the fly which
+		 * requires execution of clang-format to remain allowed, see
+		 * parse_BasedOnStyle().
+		 */
+		if (c.options.diff) {
+			if (pledge("stdio rpath wpath cpath proc exec",
+			    NULL) == -1)
+				err(1, "pledge");
+		} else if (c.options.inplace) {
+			if (pledge("stdio rpath wpath cpath fattr chown "
+			    "proc exec", NULL) == -1)
+				err(1, "pledge");
+		} else {
+			if (pledge("stdio rpath proc exec", NULL) == -1)
+				err(1, "pledge");
+		}
+		if (diff_parse(fp, name, &files, &(const struct diff_callbacks){
+		    .file	= filediffparse,
+		    .arg	= &c,
+		}, &eternal_scope, c.arena.scratch, &c.options))
+			error = 1;
+		if (c.git != NULL && git_diff_wait(c.git))
+			error = 1;
+		goto out;
+	}
+
+	filelist(argc, argv, &files, &eternal_scope);
+
+	/*
+	 * Resolve the style for all files while still being allowed to execute
+	 * clang-format, see parse_BasedOnStyle().
+	 */
+	for (i = 0; i < VECTOR_LENGTH(files.fs_vc) && c.remote == NULL; i++) {
+		struct file *fe = &files.fs_vc[i];
+
+		fe->fe_style = style_cache_lookup(c.styles,
+		    filestdin(fe) ? NULL : fe->fe_path);
+	}
+
 	if (c.options.diff) {
 		if (pledge("stdio rpath wpath cpath proc exec", NULL) == -1)
 			err(1, "pledge");
@@ -118,35 +348,19 @@ main(int argc, char *argv[])
 			err(1, "pledge");
 	}
 
-	c.simple = simple_alloc(&eternal_scope, &c.options);
-
-	c.src = arena_buffer_alloc(&buffer_scope, 1 << 12);
-	c.dst = arena_buffer_alloc(&buffer_scope, 1 << 12);
-
-	if (filelist(argc, argv, &files, &eternal_scope, c.arena.scratch,
-	    &c.options)) {
-		error = 1;
-		goto out;
-	}
-
 	for (i = 0; i < VECTOR_LENGTH(files.fs_vc); i++) {
-		struct file *fe = &files.fs_vc[i];
-
-		if (fileformat(&c, fe))
+		if (filehandle(&c, &files.fs_vc[i]))
 			error = 1;
-		buffer_reset(c.src);
-		buffer_reset(c.dst);
-		file_close(fe);
 	}
 
 out:
+	if (syncbatch(&c))
+		error = 1;
 	files_free(&files);
 	arenas_free(&c.arena);
 	style_shutdown();
 	expr_shutdown();
 	clang_shutdown();
-	if (c.options.diffparse)
-		diff_shutdown();
 
 	return error;
 }
@@ -154,73 +368,205 @@ out:
 static void
 usage(void)
 {
-	fprintf(stderr, "usage: knfmt [-Ddis] [file ...]\n");
+	fprintf(stderr, "usage: knfmt [-bDdEGiLs] [-B budget] [-C directory] "
+	    "[-F sync] [-R socket] [-S socket] [-T index] [file ...]\n");
 	exit(1);
 }
 
 static int
-filelist(int argc, char **argv, struct files *files,
-    struct arena_scope *eternal_scope, struct arena *scratch,
-    const struct options *op)
+syncparse(const char *str, enum sync_mode *sync)
 {
-	if (op->diffparse)
-		return diff_parse(files, eternal_scope, scratch, op);
+	if (strcmp(str, "none") == 0) {
+		*sync = SYNC_NONE;
+	} else if (strcmp(str, "file") == 0) {
+		*sync = SYNC_FILE;
+	} else if (strcmp(str, "batch") == 0) {
+		*sync = SYNC_BATCH;
+	} else {
+		warnx("%s: invalid sync mode", str);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Flush the files edited in place since the last batch. As opposed to sync(2),
+ * only the files in question are flushed.
+ */
+static int
+syncbatch(struct main_context *c)
+{
+	size_t i;
+	int error = 0;
+
+	for (i = 0; i < c->nsyncs; i++) {
+		if (fsync(c->syncs[i].fd) == -1) {
+			warn("%s", c->syncs[i].path);
+			error = 1;
+		}
+		close(c->syncs[i].fd);
+	}
+	c->nsyncs = 0;
+	return error;
+}
+
+/*
+ * Build the typedef index from the headers among the given files. If no header
+ * is given, or the files are Git pathspecs, all headers found in the current
+ * directory and below are used instead.
+ */
+static int
+typedefsinit(struct main_context *c, const char *path, int argc, char **argv,
+    int staged, struct arena_scope *eternal_scope)
+{
+	const char **headers;
+	size_t nheaders = 0;
+	int i;
+
+	headers = arena_calloc(eternal_scope, (size_t)argc + 1,
+	    sizeof(*headers));
+	for (i = 0; i < argc && !staged; i++) {
+		size_t len = strlen(argv[i]);
+
+		if (len > 2 && strcmp(&argv[i][len - 2], ".h") == 0)
+			headers[nheaders++] = argv[i];
+	}
+	c->typedefs = typedef_index_alloc(path, headers, nheaders,
+	    eternal_scope, c->arena.scratch);
+	return c->typedefs == NULL ? 1 : 0;
+}
 
+static void
+filelist(int argc, char **argv, struct files *files,
+    struct arena_scope *eternal_scope)
+{
 	if (argc == 0) {
-		files_alloc(files, "/dev/stdin", eternal_scope);
+		files_alloc(files, stdin_path, eternal_scope);
 	} else {
 		int i;
 
 		for (i = 0; i < argc; i++)
 			files_alloc(files, argv[i], eternal_scope);
 	}
-	return 0;
 }
 
 static int
-fileformat(struct main_context *c, struct file *fe)
+filediffparse(struct file *fe, void *arg)
 {
-	struct clang *clang;
-	struct lexer *lx = NULL;
-	struct parser *pr = NULL;
+	struct main_context *c = arg;
+
+	fe->fe_style = style_cache_lookup(c->styles, fe->fe_path);
+	return filehandle(c, fe);
+}
 
-	arena_scope(c->arena.eternal, eternal_scope);
+static int
+filehandle(struct main_context *c, struct file *fe)
+{
+	size_t bytes;
+	int error;
+
+	/*
+	 * Buffers are scoped to the file, ensuring memory spent on a large
+	 * file is released before continuing with the next one.
+	 */
+	arena_scope(c->arena.buffer, buffer_scope);
+	c->src = arena_buffer_alloc(&buffer_scope, 1 << 12);
+	c->dst = arena_buffer_alloc(&buffer_scope, 1 << 12);
+	if (c->options.edit)
+		c->edits = edit_script_alloc(&buffer_scope);
+
+	timing_reset(c->timing);
+	bytes = arenas_bytes(&c->arena);
+	error = fileformat(c, fe);
+	timing_count(c->timing, TIMING_ARENA_BYTES,
+	    arenas_bytes(&c->arena) - bytes);
+	timing_print(c->timing, fe->fe_path, error);
+	arenas_hint(&c->arena, 0);
+	c->src = NULL;
+	c->dst = NULL;
+	c->edits = NULL;
+	file_close(fe);
+	return error;
+}
 
-	if (file_read(fe, c->src))
+static int
+fileformat(struct main_context *c, struct file *fe)
+{
+	int error;
+
+	if (fe->fe_style == NULL && c->remote == NULL)
 		return 1;
+	timing_enter(c->timing, TIMING_READ);
+	if (c->git != NULL)
+		error = git_read_staged(c->git, fe->fe_path, c->src);
+	else
+		error = file_read(fe, c->src);
+	timing_leave(c->timing, TIMING_READ);
+	if (error)
+		return 1;
+	if (c->remote != NULL)
+		return fileremote(c, fe);
+	arenas_hint(&c->arena, buffer_get_len(c->src));
 
-	clang = clang_alloc(c->style, c->simple, &c->arena,
-	    fe->fe_diff, &c->options, &eternal_scope);
-	lx = lexer_tokenize(&(const struct lexer_arg){
+	if (format(&(const struct format_arg){
 	    .path		= fe->fe_path,
-	    .bf			= c->src,
-	    .op			= &c->options,
-	    .error_flush	= options_trace_level(&c->options,
-		TRACE_LEXER) > 0,
-	    .arena		= {
-		.eternal_scope	= &eternal_scope,
-		.scratch	= c->arena.scratch,
-	    },
-	    .callbacks		= clang_lexer_callbacks(clang),
-	});
-	if (lx == NULL)
-		return 1;
-	if (options_trace_level(&c->options, TRACE_TOKEN) > 0)
-		lexer_dump(lx);
-
-	pr = parser_alloc(&(struct parser_arg){
-	    .lexer	= lx,
-	    .options	= &c->options,
-	    .style	= c->style,
-	    .simple	= c->simple,
-	    .clang	= clang,
-	    .arena	= &c->arena,
-	}, &eternal_scope);
-	if (parser_exec(pr, fe->fe_diff, c->dst))
+	    .src		= c->src,
+	    .dst		= c->dst,
+	    .diff_chunks	= fe->fe_diff,
+	    .style		= fe->fe_style,
+	    .simple		= c->simple,
+	    .options		= &c->options,
+	    .arena		= &c->arena,
+	    .timing		= c->timing,
+	    .edits		= c->edits,
+	    .typedefs		= c->typedefs,
+	}))
 		return 1;
 
+	timing_enter(c->timing, TIMING_WRITE);
 	if (c->options.diff)
-		return filediff(c, fe);
+		error = filediff(c, fe);
+	else if (c->options.edit)
+		error = fileedit(c, fe);
+	else if (c->options.inplace)
+		error = filewrite(c, fe);
+	else
+		error = fileprint(c->dst);
+	timing_leave(c->timing, TIMING_WRITE);
+	return error;
+}
+
+static int
+fileremote(struct main_context *c, const struct file *fe)
+{
+	char cwd[PATH_MAX];
+	struct buffer *diagnostics;
+	const char *path = fe->fe_path;
+	int status;
+
+	arena_scope(c->arena.scratch, s);
+
+	/* The server is not necessarily running in the same directory. */
+	if (path[0] != '/') {
+		if (getcwd(cwd, sizeof(cwd)) == NULL) {
+			warn("getcwd");
+			return 1;
+		}
+		path = arena_sprintf(&s, "%s/%s", cwd, path);
+	}
+
+	diagnostics = arena_buffer_alloc(&s, 1 << 10);
+	status = server_client_request(c->remote,
+	    c->options.diff ? SERVER_DIFF : SERVER_PRINT,
+	    path, c->src, c->dst, diagnostics);
+	fwrite(buffer_get_ptr(diagnostics), 1, buffer_get_len(diagnostics),
+	    stderr);
+	if (status == -1)
+		return 1;
+	if (c->options.diff)
+		return fileprint(c->dst) ? 1 : status;
+	if (status != 0)
+		return status;
 	if (c->options.inplace)
 		return filewrite(c, fe);
 	return fileprint(c->dst);
@@ -242,19 +588,68 @@ filediff(struct main_context *c, const struct file *fe)
 	return error;
 }
 
+/*
+ * Print the edits needed to format the given file as a single line of JSON.
+ */
+static int
+fileedit(struct main_context *c, const struct file *fe)
+{
+	const struct edit *edits;
+	struct buffer *bf;
+	size_t i;
+
+	arena_scope(c->arena.scratch, s);
+
+	edits = edit_script_exec(c->edits, c->src, c->dst);
+	if (VECTOR_EMPTY(edits))
+		return 0;
+
+	bf = arena_buffer_alloc(&s, 1 << 10);
+	buffer_printf(bf, "{\"path\":");
+	json_print_string(bf, fe->fe_path, strlen(fe->fe_path));
+	buffer_printf(bf, ",\"edits\":[");
+	for (i = 0; i < VECTOR_LENGTH(edits); i++) {
+		const struct edit *ed = &edits[i];
+
+		buffer_printf(bf, "%s{\"offset\":%zu,\"length\":%zu,"
+		    "\"replacement\":", i > 0 ? "," : "", ed->ed_off,
+		    ed->ed_len);
+		json_print_string(bf, ed->ed_str, ed->ed_strlen);
+		buffer_printf(bf, "}");
+	}
+	buffer_printf(bf, "]}\n");
+	(void)fileprint(bf);
+	/* Signal that the file is not formatted, just like diff(1). */
+	return 1;
+}
+
 static int
 filewrite(struct main_context *c, const struct file *fe)
 {
 	const struct buffer *src = c->src;
 	const struct buffer *dst = c->dst;
+	unsigned int flags = 0;
+	int fd;
 
 	if (buffer_cmp(src, dst) == 0)
 		return 0;
-	if (KS_fs_replace(fe->fe_path,
-	    buffer_get_ptr(dst), buffer_get_len(dst)) == -1) {
+	if (c->sync == SYNC_FILE)
+		flags |= KS_FS_REPLACE_SYNC;
+	else if (c->sync == SYNC_BATCH)
+		flags |= KS_FS_REPLACE_KEEP;
+	/* Reuse the descriptor from file_read(), saving a lookup. */
+	fd = KS_fs_replace_fd(fe->fe_path, fe->fe_fd,
+	    buffer_get_ptr(dst), buffer_get_len(dst), flags);
+	if (fd == -1) {
 		warn("%s", fe->fe_path);
 		return 1;
 	}
+	if (c->sync == SYNC_BATCH) {
+		c->syncs[c->nsyncs].path = fe->fe_path;
+		c->syncs[c->nsyncs].fd = fd;
+		if (++c->nsyncs == SYNC_BATCH_MAX)
+			return syncbatch(c);
+	}
 	return 0;
 }
 
@@ -277,3 +672,9 @@ fileprint(const struct buffer *dst)
 	}
 	return 0;
 }
+
+static int
+filestdin(const struct file *fe)
+{
+	return strcmp(fe->fe_path, stdin_path) == 0;
+}
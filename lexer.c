@@ -48,6 +48,18 @@ struct lexer {
 
 	int			 lx_peek;
 
+	/* Incremented whenever the token list is mutated. */
+	unsigned int		 lx_generation;
+
+	/* Work spent since lexer_budget_reset(). */
+	struct {
+		unsigned long	spent;
+		unsigned long	limit;
+		int		exhausted;
+	} lx_budget;
+
+	struct lexer_stats	 lx_stats;
+
 	struct token_list	 lx_tokens;
 };
 
@@ -101,6 +113,7 @@ lexer_tokenize(const struct lexer_arg *arg)
 		if (tk == NULL)
 			goto err;
 		LIST_INSERT_TAIL(&lx->lx_tokens, tk);
+		lx->lx_stats.ntokens++;
 		if (tk->tk_flags & TOKEN_FLAG_DISCARD)
 			*ARENA_VECTOR_ALLOC(discarded) = tk;
 		if (tk->tk_type == LEXER_EOF)
@@ -166,6 +179,56 @@ lexer_get_peek(const struct lexer *lx)
 	return lx->lx_peek;
 }
 
+/*
+ * Returns a counter which changes whenever tokens are inserted, moved or
+ * removed, allowing callers to detect stale token references.
+ */
+unsigned int
+lexer_get_generation(const struct lexer *lx)
+{
+	return lx->lx_generation;
+}
+
+const struct lexer_stats *
+lexer_get_stats(const struct lexer *lx)
+{
+	return &lx->lx_stats;
+}
+
+/*
+ * Start a new work budget, a limit of zero denotes no limit. Work is accounted
+ * for as consumed and peeked tokens, in addition to any work spent by the
+ * caller, see lexer_budget_spend(). Once the budget is exhausted, no more
+ * tokens can be consumed.
+ */
+void
+lexer_budget_reset(struct lexer *lx, unsigned long limit)
+{
+	lx->lx_budget.spent = 0;
+	lx->lx_budget.limit = limit;
+	lx->lx_budget.exhausted = 0;
+}
+
+int
+lexer_budget_spend(struct lexer *lx, unsigned long work)
+{
+	if (lx->lx_budget.exhausted)
+		return 1;
+	lx->lx_budget.spent += work;
+	if (lx->lx_budget.limit == 0 ||
+	    lx->lx_budget.spent <= lx->lx_budget.limit)
+		return 0;
+	lexer_trace(lx, "budget %lu exhausted", lx->lx_budget.limit);
+	lx->lx_budget.exhausted = 1;
+	return 1;
+}
+
+int
+lexer_budget_exhausted(const struct lexer *lx)
+{
+	return lx->lx_budget.exhausted;
+}
+
 /*
  * Returns the arena scope with the same lifetime as the given lexer.
  */
@@ -390,6 +453,9 @@ lexer_pop(struct lexer *lx, struct token **tk)
 {
 	struct lexer_state *st = &lx->lx_st;
 
+	if (lexer_budget_spend(lx, 1))
+		return 0;
+
 	if (st->st_tk == NULL) {
 		*tk = st->st_tk = LIST_FIRST(&lx->lx_tokens);
 		return 1;
@@ -456,6 +522,7 @@ lexer_copy_after(struct lexer *lx, struct token *after, const struct token *src)
 	lexer_copy_token_list(lx, &src->tk_suffixes, &tk->tk_suffixes);
 	token_position_after(after, tk);
 	LIST_INSERT_AFTER(&lx->lx_tokens, after, tk);
+	lx->lx_generation++;
 	return tk;
 }
 
@@ -469,6 +536,7 @@ lexer_insert_after(struct lexer *lx, struct token *after,
 	tk->tk_flags |= token_flags_inherit(after);
 	token_position_after(after, tk);
 	LIST_INSERT_AFTER(&lx->lx_tokens, after, tk);
+	lx->lx_generation++;
 	return tk;
 }
 
@@ -481,6 +549,7 @@ lexer_move_after(struct lexer *lx, struct token *after, struct token *mv)
 	LIST_REMOVE(&lx->lx_tokens, mv);
 	token_position_after(after, mv);
 	LIST_INSERT_AFTER(&lx->lx_tokens, after, mv);
+	lx->lx_generation++;
 	return mv;
 }
 
@@ -492,6 +561,7 @@ lexer_move_before(struct lexer *lx, struct token *before, struct token *mv)
 	mv->tk_lno = before->tk_lno;
 	lx->lx_callbacks.move_prefixes(before, mv);
 	token_list_swap(&before->tk_suffixes, &mv->tk_suffixes);
+	lx->lx_generation++;
 	return mv;
 }
 
@@ -518,6 +588,7 @@ lexer_remove(struct lexer *lx, struct token *tk)
 	if (lx->lx_st.st_tk == tk)
 		lx->lx_st.st_tk = token_prev(tk);
 	token_list_remove(&lx->lx_tokens, tk);
+	lx->lx_generation++;
 }
 
 void
@@ -548,6 +619,8 @@ lexer_peek_enter(struct lexer *lx, struct lexer_state *st)
 {
 	*st = lx->lx_st;
 	lx->lx_peek++;
+	lx->lx_stats.npeeks++;
+	(void)lexer_budget_spend(lx, 1);
 }
 
 void
@@ -679,7 +752,8 @@ lexer_peek_if_pair(struct lexer *lx, int lhs_type, int rhs_type,
 			break;
 	}
 	lexer_peek_leave(lx, &s);
-	if (pair > 0)
+	/* Could run out of tokens if the work budget is exhausted. */
+	if (pair > 0 || t == NULL)
 		return 0;
 	if (rhs != NULL)
 		*rhs = t;
@@ -1007,6 +1081,12 @@ lexer_expect_error(struct lexer *lx, int type, const struct token *tk,
 {
 	struct token *t;
 
+	/* Be quiet once the work budget is exhausted, see lexer_pop(). */
+	if (lx->lx_budget.exhausted) {
+		lx->lx_st.st_flags.error = 1;
+		return;
+	}
+
 	/* Be quiet while about to branch. */
 	if (lexer_back(lx, &t) && (t->tk_flags & TOKEN_FLAG_BRANCH)) {
 		lexer_trace(lx, "%s:%d: suppressed, expected %s", fun, lno,
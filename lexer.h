@@ -40,6 +40,11 @@ struct lexer_state {
 	} st_flags;
 };
 
+struct lexer_stats {
+	unsigned long	ntokens;	/* # tokenized tokens */
+	unsigned long	npeeks;		/* # lexer_peek_enter() invocations */
+};
+
 struct lexer	*lexer_tokenize(const struct lexer_arg *);
 
 struct lexer_state	lexer_get_state(const struct lexer *);
@@ -49,6 +54,13 @@ void			lexer_set_state(struct lexer *,
 struct arena_scope	*lexer_get_arena_scope(const struct lexer *);
 const char		*lexer_get_path(const struct lexer *);
 int			 lexer_get_peek(const struct lexer *);
+unsigned int		 lexer_get_generation(const struct lexer *);
+
+const struct lexer_stats	*lexer_get_stats(const struct lexer *);
+
+void	lexer_budget_reset(struct lexer *, unsigned long);
+int	lexer_budget_spend(struct lexer *, unsigned long);
+int	lexer_budget_exhausted(const struct lexer *);
 
 int		 lexer_getc(struct lexer *, unsigned char *);
 void		 lexer_ungetc(struct lexer *);
@@ -0,0 +1,196 @@
+#include "libknfmt.h"
+
+#include "config.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>	/* UINT_MAX */
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libks/arena-buffer.h"
+#include "libks/arena-vector.h"
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/vector.h"
+
+#include "arenas.h"
+#include "clang.h"
+#include "diff.h"
+#include "expr.h"
+#include "format.h"
+#include "options.h"
+#include "simple.h"
+#include "style.h"
+
+struct knfmt {
+	struct options		 op;
+	struct arenas		 arena;
+	struct style		*style;
+	struct simple		*simple;
+	/* Memory valid until the context is freed. */
+	struct arena_scope	 eternal_scope;
+	/* Memory valid until the next call to knfmt_format(). */
+	struct arena_scope	 buffer_scope;
+};
+
+static int	range_cmp(const void *, const void *);
+
+/* Number of allocated contexts sharing the global state. */
+static unsigned int	ncontexts;
+
+/*
+ * Allocate a formatting context using the given clang-format configuration
+ * file, the default style is used if NULL. Returns NULL on error.
+ */
+struct knfmt *
+knfmt_alloc(const char *path, unsigned int flags)
+{
+	struct knfmt *kf;
+	int fd = -1;
+
+	if (path != NULL) {
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1) {
+			warn("%s", path);
+			return NULL;
+		}
+	}
+
+	if (ncontexts++ == 0) {
+		clang_init();
+		expr_init();
+		style_init();
+	}
+
+	kf = calloc(1, sizeof(*kf));
+	if (kf == NULL)
+		err(1, NULL);
+	options_init(&kf->op);
+	if (flags & KNFMT_SIMPLE)
+		kf->op.simple = 1;
+	arenas_init(&kf->arena);
+	kf->eternal_scope = arena_scope_enter(kf->arena.eternal);
+	kf->buffer_scope = arena_scope_enter(kf->arena.buffer);
+
+	kf->style = style_parse_fd(fd, path != NULL ? path : ".clang-format",
+	    &kf->eternal_scope, kf->arena.scratch, &kf->op);
+	if (fd != -1)
+		close(fd);
+	if (kf->style == NULL) {
+		knfmt_free(kf);
+		return NULL;
+	}
+	kf->simple = simple_alloc(&kf->eternal_scope, &kf->op);
+	return kf;
+}
+
+void
+knfmt_free(struct knfmt *kf)
+{
+	if (kf == NULL)
+		return;
+
+	arena_scope_leave(&kf->buffer_scope);
+	arena_scope_leave(&kf->eternal_scope);
+	arenas_free(&kf->arena);
+	free(kf);
+
+	if (--ncontexts == 0) {
+		style_shutdown();
+		expr_shutdown();
+		clang_shutdown();
+	}
+}
+
+/*
+ * Format the given source code, where path is only used in diagnostics. If any
+ * ranges are given, only the corresponding lines are formatted. Returns the
+ * formatted source code which remains valid until the next invocation using
+ * the same context, or NULL on error including invalid ranges.
+ */
+const char *
+knfmt_format(struct knfmt *kf, const char *path, const char *src,
+    size_t srclen, const struct knfmt_range *ranges, size_t nranges,
+    size_t *dstlen)
+{
+	VECTOR(struct diffchunk) chunks = NULL;
+	struct buffer *bf, *dst;
+	size_t i;
+	int error;
+
+	for (i = 0; i < nranges; i++) {
+		const struct knfmt_range *r = &ranges[i];
+
+		if (r->beg == 0 || r->beg > r->end || r->end == UINT_MAX) {
+			warnx("%s: %u-%u: invalid range", path, r->beg,
+			    r->end);
+			return NULL;
+		}
+	}
+
+	arena_scope_leave(&kf->buffer_scope);
+	kf->buffer_scope = arena_scope_enter(kf->arena.buffer);
+
+	bf = arena_buffer_alloc(&kf->buffer_scope, srclen + 1);
+	buffer_puts(bf, src, srclen);
+	dst = arena_buffer_alloc(&kf->buffer_scope, srclen + 1);
+
+	if (nranges > 0) {
+		struct knfmt_range *sorted;
+
+		/* Chunks are expected to be sorted and disjoint. */
+		sorted = arena_calloc(&kf->buffer_scope, nranges,
+		    sizeof(*sorted));
+		for (i = 0; i < nranges; i++)
+			sorted[i] = ranges[i];
+		qsort(sorted, nranges, sizeof(*sorted), range_cmp);
+		ARENA_VECTOR_INIT(&kf->buffer_scope, chunks, nranges);
+		for (i = 0; i < nranges; i++) {
+			struct diffchunk *last;
+
+			last = VECTOR_LAST(chunks);
+			if (last != NULL && sorted[i].beg <= last->du_end + 1) {
+				if (sorted[i].end > last->du_end)
+					last->du_end = sorted[i].end;
+				continue;
+			}
+			*ARENA_VECTOR_ALLOC(chunks) = (struct diffchunk){
+			    .du_beg	= sorted[i].beg,
+			    .du_end	= sorted[i].end,
+			};
+		}
+	}
+	kf->op.diffparse = nranges > 0;
+
+	arenas_hint(&kf->arena, srclen);
+	error = format(&(const struct format_arg){
+	    .path		= path,
+	    .src		= bf,
+	    .dst		= dst,
+	    .diff_chunks	= chunks,
+	    .style		= kf->style,
+	    .simple		= kf->simple,
+	    .options		= &kf->op,
+	    .arena		= &kf->arena,
+	});
+	arenas_hint(&kf->arena, 0);
+	if (error)
+		return NULL;
+
+	*dstlen = buffer_get_len(dst);
+	return buffer_get_ptr(dst);
+}
+
+static int
+range_cmp(const void *p1, const void *p2)
+{
+	const struct knfmt_range *r1 = p1;
+	const struct knfmt_range *r2 = p2;
+
+	if (r1->beg < r2->beg)
+		return -1;
+	if (r1->beg > r2->beg)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Embeddable interface to knfmt. A context holds the parsed style along with
+ * all memory needed while formatting, allowing many buffers to be formatted
+ * without paying for process creation nor initialization over and over again.
+ * Contexts are not thread safe and must all be allocated and freed by the same
+ * thread. Diagnostics are written to standard error and allocation failures are
+ * fatal, just like the knfmt utility.
+ */
+
+#ifndef LIBKNFMT_H
+#define LIBKNFMT_H
+
+#include <stddef.h>	/* size_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Simplify the source code, see knfmt -s. */
+#define KNFMT_SIMPLE	0x00000001u
+
+/* Inclusive range of lines, starting from 1. */
+struct knfmt_range {
+	unsigned int	beg;
+	unsigned int	end;
+};
+
+struct knfmt;
+
+struct knfmt	*knfmt_alloc(const char *, unsigned int);
+void		 knfmt_free(struct knfmt *);
+const char	*knfmt_format(struct knfmt *, const char *, const char *,
+    size_t, const struct knfmt_range *, size_t, size_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !LIBKNFMT_H */
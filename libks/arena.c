@@ -16,6 +16,8 @@
 
 #include "libks/arena.h"
 
+#include <sys/mman.h>
+
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -46,6 +48,25 @@
 
 #define MAX_SOURCE_LOCATIONS 8
 
+/*
+ * Default number of initial frame sizes worth of released frames kept for
+ * reuse per arena, see ARENA_FRAMES. Any other released frame is immediately
+ * returned to the kernel, keeping the footprint proportional to the current
+ * workload rather than the largest one seen.
+ */
+#define MAX_RECYCLED_FRAMES 256
+
+/*
+ * Upper bound for geometric growth of frames, in number of initial frame
+ * sizes. Further capped by the retained size in order for grown frames to be
+ * reused instead of unmapped. Larger allocations still get a frame of
+ * sufficient size.
+ */
+#define MAX_GROWTH_FRAMES 256
+
+/* Frames eligible for huge pages, see ARENA_FRAMES. */
+#define HUGE_FRAME_SIZE (2 * 1024 * 1024)
+
 #if defined(ARENA_TRACE)
 
 #define arena_trace_name(a, b) do {					\
@@ -127,20 +148,25 @@ struct arena_frame {
 
 struct arena {
 	struct arena_frame	*frame;
+	/* Released frames kept for reuse, see MAX_RECYCLED_FRAMES. */
+	struct arena_frame	*recycle;
+	size_t			 recycle_size;
+	size_t			 recycle_max;
 	/* Initial heap frame size, multiple of page size. */
 	size_t			 frame_size;
+	/* Minimum size of the next frame, see arena_frame_hint(). */
+	size_t			 frame_hint;
+	/* Upper bound for geometric growth of frames. */
+	size_t			 frame_max;
+	unsigned int		 frame_flags;
+#define FRAME_HUGE	0x00000001u
+#define FRAME_POPULATE	0x00000002u
 	/* Number of ASAN poison bytes between allocations. */
 	size_t			 poison_size;
 	int			 refs;
 	struct source_location	 scope_locations[MAX_SOURCE_LOCATIONS];
 
-	struct {
-		struct {
-			size_t	now;
-			size_t	max;
-			size_t	total;
-		} bytes, frames, scopes;
-	} stats;
+	struct arena_stats	 stats;
 
 	struct {
 		int	fd;
@@ -210,6 +236,75 @@ arena_trace_name_impl(const struct arena *a, const char *name)
 
 #endif
 
+static int
+frame_size_parse(const char *str, size_t len, size_t *res)
+{
+	size_t shift = 0;
+	size_t size = 0;
+	size_t i;
+
+	for (i = 0; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+		if (KS_size_mul_overflow(size, 10, &size) ||
+		    KS_size_add_overflow(size, (size_t)(str[i] - '0'), &size))
+			return 0;
+	}
+	if (i == 0)
+		return 0;
+	if (i + 1 == len) {
+		switch (str[i]) {
+		case 'G':
+			shift = 30;
+			break;
+		case 'M':
+			shift = 20;
+			break;
+		case 'K':
+			shift = 10;
+			break;
+		default:
+			return 0;
+		}
+	} else if (i != len) {
+		return 0;
+	}
+	if (shift > 0 && size > (SIZE_MAX >> shift))
+		return 0;
+	*res = size << shift;
+	return 1;
+}
+
+/*
+ * Parse the optional ARENA_FRAMES environment variable, a comma separated list
+ * of the following settings:
+ *
+ *     huge           back frames large enough by huge pages
+ *     populate       prefault frames large enough
+ *     retain=size    amount of released frames kept for reuse, optionally
+ *                    suffixed with K, M or G
+ */
+static void
+frame_options(struct arena *a)
+{
+	const char *str;
+
+	str = getenv("ARENA_FRAMES");
+	while (str != NULL && *str != '\0') {
+		size_t len;
+
+		len = strcspn(str, ",");
+		if (len == 4 && strncmp(str, "huge", len) == 0)
+			a->frame_flags |= FRAME_HUGE;
+		else if (len == 8 && strncmp(str, "populate", len) == 0)
+			a->frame_flags |= FRAME_POPULATE;
+		else if (len > 7 && strncmp(str, "retain=", 7) == 0)
+			(void)frame_size_parse(&str[7], len - 7,
+			    &a->recycle_max);
+		str += len;
+		if (*str == ',')
+			str++;
+	}
+}
+
 static size_t
 poison_size(void)
 {
@@ -255,6 +350,47 @@ frame_unpoison(const struct arena_frame *frame, size_t size,
 	}
 }
 
+static struct arena_frame *
+frame_map(size_t size, unsigned int flags)
+{
+	void *ptr = MAP_FAILED;
+	int mapflags = MAP_PRIVATE | MAP_ANON;
+
+	if (size < HUGE_FRAME_SIZE)
+		flags = 0;
+#if defined(MAP_POPULATE)
+	if (flags & FRAME_POPULATE)
+		mapflags |= MAP_POPULATE;
+#endif
+#if defined(MAP_HUGETLB)
+	/* Requires reserved huge pages, fallback to transparent ones. */
+	if ((flags & FRAME_HUGE) && size % HUGE_FRAME_SIZE == 0) {
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    mapflags | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	if (ptr == MAP_FAILED) {
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, mapflags, -1, 0);
+		if (ptr == MAP_FAILED)
+			return NULL;
+#if defined(MADV_HUGEPAGE)
+		if (flags & FRAME_HUGE)
+			(void)madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+	}
+	return ptr;
+}
+
+static void
+frame_unmap(struct arena_frame *frame)
+{
+	size_t size = frame->size;
+
+	ASAN_UNPOISON_MEMORY_REGION(frame, size);
+	KS_valgrind_make_mem_undefined(frame, size);
+	munmap(frame, size);
+}
+
 static union address
 align_address(const struct arena *a, union address addr)
 {
@@ -306,6 +442,12 @@ arena_rele(struct arena *a)
 {
 	if (--a->refs > 0)
 		return;
+	while (a->recycle != NULL) {
+		struct arena_frame *frame = a->recycle;
+
+		a->recycle = frame->next;
+		frame_unmap(frame);
+	}
 	free(a);
 }
 
@@ -355,22 +497,58 @@ arena_push(struct arena *a, struct arena_frame *frame, size_t size,
 	return arena_push_impl(a, frame, size, poison, 0);
 }
 
+/*
+ * Release the given frame, either by keeping it for reuse or by returning it
+ * to the kernel.
+ */
+static void
+arena_frame_release(struct arena *a, struct arena_frame *frame)
+{
+	if (a->recycle_size + frame->size > a->recycle_max) {
+		frame_unmap(frame);
+		return;
+	}
+
+	frame->next = a->recycle;
+	a->recycle = frame;
+	a->recycle_size += frame->size;
+	/* Only the frame itself must remain accessible. */
+	frame_poison_with_len(frame, sizeof(*frame));
+}
+
+/*
+ * Allocate a frame of at least the given size, favoring the smallest sufficient
+ * released frame.
+ */
 static int
 arena_frame_alloc(struct arena *a, size_t frame_size)
 {
+	struct arena_frame **best = NULL;
+	struct arena_frame **prev;
 	struct arena_frame *frame;
 
-	frame = malloc(frame_size);
-	if (frame == NULL)
-		return 0;
+	for (prev = &a->recycle; *prev != NULL; prev = &(*prev)->next) {
+		if ((*prev)->size >= frame_size &&
+		    (best == NULL || (*prev)->size < (*best)->size))
+			best = prev;
+	}
+	if (best != NULL) {
+		frame = *best;
+		*best = frame->next;
+		a->recycle_size -= frame->size;
+	} else {
+		frame = frame_map(frame_size, a->frame_flags);
+		if (frame == NULL)
+			return 0;
+		frame->size = frame_size;
+	}
 	frame->ptr = (char *)frame;
-	frame->size = frame_size;
 	frame->len = 0;
 	frame->next = NULL;
 	const void *ptr = arena_push_internal(a, frame, sizeof(*frame),
 	    POISON_DEFINED);
 	if (ptr == NULL) {
-		free(frame);
+		frame_unmap(frame);
 		return 0;
 	}
 
@@ -399,6 +577,12 @@ arena_alloc(const char *name)
 		err(1, "%s", __func__);
 	a->trace.fd = -1;
 	a->frame_size = 16 * (size_t)page_size;
+	a->recycle_max = MAX_RECYCLED_FRAMES * a->frame_size;
+	frame_options(a);
+	/* Grown frames must be eligible for reuse once released. */
+	a->frame_max = MAX_GROWTH_FRAMES * a->frame_size;
+	if (a->frame_max > a->recycle_max)
+		a->frame_max = a->recycle_max;
 	a->poison_size = poison_size();
 	arena_ref(a);
 	if (!arena_frame_alloc(a, a->frame_size))
@@ -458,7 +642,7 @@ arena_scope_leave(struct arena_scope *s)
 		struct arena_frame *frame = a->frame;
 
 		a->frame = frame->next;
-		free(frame);
+		arena_frame_release(a, frame);
 	}
 	if (a->frame != NULL) {
 		a->frame->len = s->frame_len <= a->frame->len ?
@@ -550,7 +734,15 @@ arena_malloc(struct arena_scope *s, size_t size)
 	    KS_size_add_overflow(a->poison_size, total_size, &total_size))
 		errx(1, "%s: Requested allocation too large", __func__);
 
+	/*
+	 * Grow frames geometrically, reducing the number of frames needed by
+	 * allocation heavy scopes.
+	 */
 	frame_size = a->frame_size;
+	while (frame_size <= a->frame_max / 2 &&
+	    (frame_size < a->frame_hint || frame_size <= a->frame->size))
+		frame_size *= 2;
+	a->frame_hint = 0;
 	while (frame_size < total_size) {
 		if (KS_size_mul_overflow(2, frame_size, &frame_size)) {
 			errx(1, "%s: Requested allocation exceeds frame size",
@@ -707,6 +899,35 @@ arena_capacity(const struct arena_scope *s)
 	return frame->size - frame->len;
 }
 
+const struct arena_stats *
+arena_get_stats(const struct arena *a)
+{
+	return &a->stats;
+}
+
+/*
+ * Hint the size of the next frame, allowing callers anticipating a large
+ * amount of allocations to avoid growing frames gradually. The hint is
+ * consumed by the next frame allocation.
+ */
+void
+arena_frame_hint(struct arena *a, size_t size)
+{
+	a->frame_hint = size;
+}
+
+/*
+ * Reset the high-water marks to the current usage, allowing the peak usage of
+ * a subsequent unit of work to be observed.
+ */
+void
+arena_stats_reset(struct arena *a)
+{
+	a->stats.bytes.max = a->stats.bytes.now;
+	a->stats.frames.max = a->stats.frames.now;
+	a->stats.scopes.max = a->stats.scopes.now;
+}
+
 void
 arena_poison(const void *ptr, size_t size)
 {
@@ -79,6 +79,14 @@ struct arena_trace_event {
 	} type;
 };
 
+struct arena_stats {
+	struct {
+		size_t	now;
+		size_t	max;
+		size_t	total;
+	} bytes, frames, scopes;
+};
+
 struct arena	*arena_alloc(const char *);
 void		 arena_free(struct arena *);
 
@@ -108,5 +116,9 @@ void    arena_cleanup(struct arena_scope *, void (*)(void *), void *);
 
 size_t	arena_capacity(const struct arena_scope *);
 void	arena_poison(const void *, size_t);
+void	arena_frame_hint(struct arena *, size_t);
+
+const struct arena_stats	*arena_get_stats(const struct arena *);
+void				 arena_stats_reset(struct arena *);
 
 #endif /* !LIBKS_ARENA_H */
@@ -14,6 +14,11 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if defined(__linux__)
+/* O_TMPFILE */
+#define _GNU_SOURCE
+#endif
+
 #include "libks/fs.h"
 
 #include <sys/types.h>
@@ -27,6 +32,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "libks/compiler.h"
+
 static int
 construct_hidden_path(const char *path, char *buf, size_t bufsiz)
 {
@@ -59,71 +66,205 @@ construct_hidden_path(const char *path, char *buf, size_t bufsiz)
 }
 
 static int
-inherit_ownership_and_permissions(int srcfd, int dstfd)
+inherit_ownership_and_permissions(const struct stat *srcsb, int dstfd)
 {
-	struct stat dstsb, srcsb;
+	struct stat dstsb;
 
-	if (fstat(srcfd, &srcsb) == -1)
-		return -1;
 	if (fstat(dstfd, &dstsb) == -1)
 		return -1;
 
-	if (srcsb.st_mode != dstsb.st_mode &&
-	    fchmod(dstfd, srcsb.st_mode) == -1)
+	if (srcsb->st_mode != dstsb.st_mode &&
+	    fchmod(dstfd, srcsb->st_mode) == -1)
 		return -1;
-	if ((srcsb.st_uid != dstsb.st_uid || srcsb.st_gid != dstsb.st_gid) &&
-	    fchown(dstfd, srcsb.st_uid, srcsb.st_gid) == -1)
+	if ((srcsb->st_uid != dstsb.st_uid || srcsb->st_gid != dstsb.st_gid) &&
+	    fchown(dstfd, srcsb->st_uid, srcsb->st_gid) == -1)
 		return -1;
 
 	return 0;
 }
 
+#if defined(O_TMPFILE)
+
+/* Cleared once unnamed temporary files turn out to be unusable. */
+static int unnamed_supported = 1;
+
+/*
+ * Create an unnamed temporary file in the same directory as the given path,
+ * never visible in the file system until linked.
+ */
+static int
+open_unnamed(const char *path, const struct stat *sb)
+{
+	char dir[PATH_MAX];
+	const char *p;
+	int n;
+
+	if (!unnamed_supported)
+		return -1;
+
+	p = strrchr(path, '/');
+	if (p == NULL)
+		n = snprintf(dir, sizeof(dir), ".");
+	else if (p == path)
+		n = snprintf(dir, sizeof(dir), "/");
+	else
+		n = snprintf(dir, sizeof(dir), "%.*s", (int)(p - path), path);
+	if (n < 0 || (size_t)n >= sizeof(dir))
+		return -1;
+	return open(dir, O_TMPFILE | O_WRONLY | O_CLOEXEC,
+	    sb->st_mode & 0777);
+}
+
+/*
+ * Link the unnamed temporary file using the given hidden path template.
+ */
+static int
+link_unnamed(int fd, char *path)
+{
+	static unsigned int seq;
+	char fdpath[64];
+	size_t len;
+	int i, n;
+
+	n = snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", fd);
+	if (n < 0 || (size_t)n >= sizeof(fdpath)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	len = strlen(path);
+	for (i = 0; i < 128; i++) {
+		unsigned int id = ((unsigned int)getpid() << 12) ^ seq++;
+
+		(void)snprintf(&path[len - 6], 7, "%06x", id & 0xffffffU);
+		if (linkat(AT_FDCWD, fdpath, AT_FDCWD, path,
+		    AT_SYMLINK_FOLLOW) == 0)
+			return 0;
+		if (errno != EEXIST)
+			return -1;
+	}
+	return -1;
+}
+
+#else
+
+static int
+open_unnamed(const char *UNUSED(path), const struct stat *UNUSED(sb))
+{
+	return -1;
+}
+
+static int
+link_unnamed(int UNUSED(fd), char *UNUSED(path))
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+#endif
+
+static int
+open_named(char *path)
+{
+	mode_t old_umask;
+	int fd;
+
+	old_umask = umask(0022);
+	fd = mkstemp(path);
+	umask(old_umask);
+	return fd;
+}
+
 int
 KS_fs_replace(const char *path, const char *buf, size_t buflen)
 {
-	char tmppath[PATH_MAX] = {0};
-	mode_t old_umask;
-	int tmpfd = -1;
-	int error = -1;
-	int srcfd;
+	int error, srcfd;
 
 	srcfd = open(path, O_RDONLY | O_CLOEXEC);
 	if (srcfd == -1)
-		goto out;
+		return -1;
+	error = KS_fs_replace_fd(path, srcfd, buf, buflen, 0);
+	close(srcfd);
+	return error;
+}
+
+/*
+ * Atomically replace the contents of the file at the given path, already opened
+ * as srcfd, while retaining its ownership and permissions. Where supported,
+ * the new contents are written to an unnamed temporary file which is only
+ * linked into the file system before being renamed over the original, leaving
+ * nothing behind if interrupted. If KS_FS_REPLACE_SYNC is given, the new
+ * contents are flushed to disk before replacing the original. If
+ * KS_FS_REPLACE_KEEP is given, the descriptor of the new contents is returned
+ * on success and must be closed by the caller.
+ */
+int
+KS_fs_replace_fd(const char *path, int srcfd, const char *buf, size_t buflen,
+    unsigned int flags)
+{
+	char tmppath[PATH_MAX];
+	struct stat sb;
+	const char *ptr = buf;
+	size_t len = buflen;
+	int error = -1;
+	int linked = 0;
+	int tmpfd;
 
+	if (fstat(srcfd, &sb) == -1)
+		return -1;
 	if (construct_hidden_path(path, tmppath, sizeof(tmppath)) == -1)
-		goto out;
+		return -1;
 
-	old_umask = umask(0022);
-	tmpfd = mkstemp(tmppath);
-	umask(old_umask);
-	if (tmpfd == -1)
-		goto out;
-	while (buflen > 0) {
+	tmpfd = open_unnamed(path, &sb);
+	if (tmpfd == -1) {
+		tmpfd = open_named(tmppath);
+		if (tmpfd == -1)
+			return -1;
+		linked = 1;
+	}
+
+	while (len > 0) {
 		ssize_t nw;
 
-		nw = write(tmpfd, buf, buflen);
+		nw = write(tmpfd, ptr, len);
 		if (nw == -1)
 			goto out;
-		buf += nw;
-		buflen -= (size_t)nw;
+		ptr += nw;
+		len -= (size_t)nw;
 	}
 
-	if (inherit_ownership_and_permissions(srcfd, tmpfd) == -1)
+	if (inherit_ownership_and_permissions(&sb, tmpfd) == -1)
+		goto out;
+	if ((flags & KS_FS_REPLACE_SYNC) && fsync(tmpfd) == -1)
 		goto out;
 
+	if (!linked) {
+		if (link_unnamed(tmpfd, tmppath) == -1) {
+#if defined(O_TMPFILE)
+			/* Missing /proc, fallback to a named temporary file. */
+			if (errno == ENOENT) {
+				unnamed_supported = 0;
+				close(tmpfd);
+				return KS_fs_replace_fd(path, srcfd, buf,
+				    buflen, flags);
+			}
+#endif
+			goto out;
+		}
+		linked = 1;
+	}
+
 	if (rename(tmppath, path) == -1)
 		goto out;
-
+	linked = 0;
 	error = 0;
+	if (flags & KS_FS_REPLACE_KEEP)
+		return tmpfd;
 
 out:
-	if (tmppath[0] != '\0')
+	if (linked)
 		(void)unlink(tmppath);
-	if (srcfd != -1)
-		close(srcfd);
-	if (tmpfd != -1)
-		close(tmpfd);
+	close(tmpfd);
 	return error;
 }
 
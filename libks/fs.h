@@ -19,7 +19,12 @@
 
 #include <stddef.h>	/* size_t */
 
+#define KS_FS_REPLACE_SYNC	0x00000001u
+#define KS_FS_REPLACE_KEEP	0x00000002u
+
 int	KS_fs_replace(const char *, const char *, size_t);
+int	KS_fs_replace_fd(const char *, int, const char *, size_t,
+    unsigned int);
 int	KS_fs_tmpfd(const char *, size_t, char *, size_t);
 
 #endif /* !LIBKS_FS_H */
@@ -0,0 +1,741 @@
+#include "lsp.h"
+
+#include "config.h"
+
+#include <ctype.h>
+#include <err.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libks/arena-buffer.h"
+#include "libks/arena-vector.h"
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/compiler.h"
+#include "libks/map.h"
+#include "libks/vector.h"
+
+#include "arenas.h"
+#include "diff.h"
+#include "format.h"
+#include "json.h"
+#include "options.h"
+#include "style-cache.h"
+#include "util.h"
+
+/* JSON-RPC and Language Server Protocol error codes. */
+#define LSP_PARSE_ERROR			-32700
+#define LSP_INVALID_REQUEST		-32600
+#define LSP_METHOD_NOT_FOUND		-32601
+#define LSP_INVALID_PARAMS		-32602
+#define LSP_SERVER_NOT_INITIALIZED	-32002
+#define LSP_REQUEST_FAILED		-32803
+
+/*
+ * Maximum number of lines examined while searching for the next line common to
+ * both the source and formatted source code.
+ */
+#define LSP_SYNC_MAX	1024
+
+struct lsp_document {
+	/* Path derived from the URI, used to resolve the style. */
+	char		*path;
+	struct buffer	*text;
+	struct style	*style;
+};
+
+struct lsp {
+	const struct lsp_arg			*arg;
+	MAP(const char, *, struct lsp_document)	 documents;
+	int					 initialized;
+	int					 shutdown;
+	int					 exit;
+};
+
+struct lsp_method {
+	const char	*name;
+	int		 (*fun)(struct lsp *, const struct json *,
+	    struct buffer *, struct arena_scope *);
+};
+
+struct lsp_line {
+	const char	*ptr;
+	size_t		 len;
+	uint64_t	 hash;
+};
+
+static void		 lsp_free(struct lsp *);
+static struct buffer	*lsp_read(struct arena_scope *);
+static void		 lsp_dispatch(struct lsp *, const struct buffer *,
+    struct arena_scope *);
+static void		 lsp_send(const struct json *, int,
+    const struct buffer *, struct arena_scope *);
+
+static int	lsp_initialize(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_initialized(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_shutdown(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_exit(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_did_open(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_did_change(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_did_close(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_formatting(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_range_formatting(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+static int	lsp_on_type_formatting(struct lsp *, const struct json *,
+    struct buffer *, struct arena_scope *);
+
+static struct lsp_document	*lsp_document_find(struct lsp *,
+    const struct json *);
+static void			 lsp_document_free(struct lsp_document *);
+
+static int	lsp_format(struct lsp *, const struct json *,
+    const struct diffchunk *, struct buffer *, struct arena_scope *);
+static void	lsp_edits(const struct buffer *, const struct buffer *,
+    struct buffer *, struct arena_scope *);
+static void	lsp_edit(struct buffer *, const struct lsp_line *, size_t,
+    size_t, size_t, const struct lsp_line *, size_t, size_t);
+static void	lsp_position(struct buffer *, const struct lsp_line *, size_t,
+    size_t);
+
+static struct lsp_line	*split_lines(const struct buffer *,
+    struct arena_scope *);
+static void		 sync_lines(const struct lsp_line *, size_t, size_t,
+    const struct lsp_line *, size_t, size_t, size_t *, size_t *);
+static int		 line_equal(const struct lsp_line *,
+    const struct lsp_line *);
+static unsigned int	 utf16_len(const char *, size_t);
+static char		*uri_path(const char *);
+
+static const struct lsp_method methods[] = {
+	{ "initialize",				lsp_initialize },
+	{ "initialized",			lsp_initialized },
+	{ "shutdown",				lsp_shutdown },
+	{ "exit",				lsp_exit },
+	{ "textDocument/didOpen",		lsp_did_open },
+	{ "textDocument/didChange",		lsp_did_change },
+	{ "textDocument/didClose",		lsp_did_close },
+	{ "textDocument/formatting",		lsp_formatting },
+	{ "textDocument/rangeFormatting",	lsp_range_formatting },
+	{ "textDocument/onTypeFormatting",	lsp_on_type_formatting },
+};
+
+/*
+ * Speak the Language Server Protocol on standard input and output until told to
+ * exit. Open documents are kept in memory along with their resolved style.
+ * Formatting requests are answered using edits confined to the changed lines,
+ * where range formatting is honored using the same machinery as the -D option.
+ */
+int
+lsp_run(const struct lsp_arg *arg)
+{
+	struct lsp lsp = {.arg = arg};
+
+	if (MAP_INIT(lsp.documents))
+		err(1, NULL);
+
+	while (!lsp.exit) {
+		struct buffer *msg;
+
+		arena_scope(arg->arena->buffer, s);
+
+		msg = lsp_read(&s);
+		if (msg == NULL)
+			break;
+		lsp_dispatch(&lsp, msg, &s);
+	}
+
+	lsp_free(&lsp);
+	return lsp.exit && lsp.shutdown ? 0 : 1;
+}
+
+static void
+lsp_free(struct lsp *lsp)
+{
+	MAP_ITERATOR(lsp->documents) it = {0};
+
+	while (MAP_ITERATE(lsp->documents, &it))
+		lsp_document_free(it.val);
+	MAP_FREE(lsp->documents);
+}
+
+/*
+ * Read message preceded by headers, where only the content length is honored.
+ */
+static struct buffer *
+lsp_read(struct arena_scope *s)
+{
+	static const char content_length[] = "Content-Length:";
+	struct buffer *bf;
+	char *line = NULL;
+	size_t linesiz = 0;
+	size_t len = 0;
+	int found = 0;
+
+	for (;;) {
+		if (getline(&line, &linesiz, stdin) == -1) {
+			free(line);
+			return NULL;
+		}
+		if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0)
+			break;
+		if (strncasecmp(line, content_length,
+		    sizeof(content_length) - 1) == 0) {
+			char *end;
+
+			len = strtoul(&line[sizeof(content_length) - 1], &end,
+			    10);
+			found = end != &line[sizeof(content_length) - 1];
+		}
+	}
+	free(line);
+	if (!found) {
+		warnx("missing content length");
+		return NULL;
+	}
+
+	/* Let the buffer grow as the message is read. */
+	bf = arena_buffer_alloc(s, len < (1 << 20) ? len + 1 : 1 << 20);
+	if (read_buffer(stdin, bf, len)) {
+		warnx("short message");
+		return NULL;
+	}
+	return bf;
+}
+
+static void
+lsp_dispatch(struct lsp *lsp, const struct buffer *msg, struct arena_scope *s)
+{
+	const struct lsp_method *method = NULL;
+	const struct json *id, *params;
+	struct buffer *result;
+	struct json *js;
+	const char *name;
+	size_t i;
+	int error;
+
+	js = json_parse(buffer_get_ptr(msg), buffer_get_len(msg), s);
+	if (js == NULL) {
+		lsp_send(NULL, LSP_PARSE_ERROR, NULL, s);
+		return;
+	}
+	id = json_get(js, "id");
+	params = json_get(js, "params");
+	name = json_get_string(js, "method", NULL);
+	/* Ignore responses as no requests are sent to the client. */
+	if (name == NULL)
+		return;
+
+	for (i = 0; i < countof(methods); i++) {
+		if (strcmp(methods[i].name, name) == 0) {
+			method = &methods[i];
+			break;
+		}
+	}
+
+	result = arena_buffer_alloc(s, 1 << 10);
+	if (method == NULL)
+		error = LSP_METHOD_NOT_FOUND;
+	else if (!lsp->initialized && method->fun != lsp_initialize &&
+	    method->fun != lsp_exit)
+		error = LSP_SERVER_NOT_INITIALIZED;
+	else if (lsp->shutdown && method->fun != lsp_exit)
+		error = LSP_INVALID_REQUEST;
+	else
+		error = method->fun(lsp, params, result, s);
+	/* Notifications are never answered. */
+	if (id != NULL)
+		lsp_send(id, error, result, s);
+}
+
+static void
+lsp_send(const struct json *id, int error, const struct buffer *result,
+    struct arena_scope *s)
+{
+	struct buffer *bf;
+
+	bf = arena_buffer_alloc(s, 1 << 10);
+	buffer_printf(bf, "{\"jsonrpc\":\"2.0\",\"id\":");
+	if (id != NULL)
+		buffer_puts(bf, id->js_raw, id->js_rawlen);
+	else
+		buffer_printf(bf, "null");
+	if (error) {
+		buffer_printf(bf, ",\"error\":{\"code\":%d,\"message\":",
+		    error);
+		switch (error) {
+		case LSP_PARSE_ERROR:
+			buffer_printf(bf, "\"parse error\"");
+			break;
+		case LSP_METHOD_NOT_FOUND:
+			buffer_printf(bf, "\"method not found\"");
+			break;
+		case LSP_INVALID_PARAMS:
+			buffer_printf(bf, "\"invalid params\"");
+			break;
+		case LSP_SERVER_NOT_INITIALIZED:
+			buffer_printf(bf, "\"server not initialized\"");
+			break;
+		case LSP_REQUEST_FAILED:
+			buffer_printf(bf, "\"formatting failed\"");
+			break;
+		default:
+			buffer_printf(bf, "\"invalid request\"");
+			break;
+		}
+		buffer_printf(bf, "}}");
+	} else {
+		buffer_printf(bf, ",\"result\":");
+		if (result != NULL && buffer_get_len(result) > 0) {
+			buffer_puts(bf, buffer_get_ptr(result),
+			    buffer_get_len(result));
+		} else {
+			buffer_printf(bf, "null");
+		}
+		buffer_putc(bf, '}');
+	}
+
+	printf("Content-Length: %zu\r\n\r\n", buffer_get_len(bf));
+	fwrite(buffer_get_ptr(bf), 1, buffer_get_len(bf), stdout);
+	if (fflush(stdout) == EOF)
+		warn("write: /dev/stdout");
+}
+
+static int
+lsp_initialize(struct lsp *lsp, const struct json *UNUSED(params),
+    struct buffer *result, struct arena_scope *UNUSED(s))
+{
+	lsp->initialized = 1;
+	buffer_printf(result, "{\"capabilities\":{"
+	    "\"textDocumentSync\":{\"openClose\":true,\"change\":1},"
+	    "\"documentFormattingProvider\":true,"
+	    "\"documentRangeFormattingProvider\":true,"
+	    "\"documentOnTypeFormattingProvider\":{"
+	    "\"firstTriggerCharacter\":\"}\","
+	    "\"moreTriggerCharacter\":[\";\"]}},"
+	    "\"serverInfo\":{\"name\":\"knfmt\"}}");
+	return 0;
+}
+
+static int
+lsp_initialized(struct lsp *UNUSED(lsp), const struct json *UNUSED(params),
+    struct buffer *UNUSED(result), struct arena_scope *UNUSED(s))
+{
+	return 0;
+}
+
+static int
+lsp_shutdown(struct lsp *lsp, const struct json *UNUSED(params),
+    struct buffer *UNUSED(result), struct arena_scope *UNUSED(s))
+{
+	lsp->shutdown = 1;
+	return 0;
+}
+
+static int
+lsp_exit(struct lsp *lsp, const struct json *UNUSED(params),
+    struct buffer *UNUSED(result), struct arena_scope *UNUSED(s))
+{
+	lsp->exit = 1;
+	return 0;
+}
+
+static int
+lsp_did_open(struct lsp *lsp, const struct json *params,
+    struct buffer *UNUSED(result), struct arena_scope *UNUSED(s))
+{
+	const struct json *td = json_get(params, "textDocument");
+	struct lsp_document *doc;
+	const char *text, *uri;
+	size_t len;
+
+	uri = json_get_string(td, "uri", NULL);
+	text = json_get_string(td, "text", &len);
+	if (uri == NULL || text == NULL)
+		return LSP_INVALID_PARAMS;
+
+	doc = MAP_FIND(lsp->documents, uri);
+	if (doc != NULL) {
+		lsp_document_free(doc);
+		MAP_REMOVE(lsp->documents, uri);
+	}
+	doc = MAP_INSERT(lsp->documents, uri);
+	if (doc == NULL)
+		err(1, NULL);
+	doc->path = uri_path(uri);
+	doc->text = buffer_alloc(len + 1);
+	if (doc->text == NULL)
+		err(1, NULL);
+	buffer_puts(doc->text, text, len);
+	doc->style = style_cache_lookup(lsp->arg->styles, doc->path);
+	return 0;
+}
+
+static int
+lsp_did_change(struct lsp *lsp, const struct json *params,
+    struct buffer *UNUSED(result), struct arena_scope *UNUSED(s))
+{
+	const struct json *change;
+	struct lsp_document *doc;
+
+	doc = lsp_document_find(lsp, params);
+	if (doc == NULL)
+		return LSP_INVALID_PARAMS;
+
+	/* Only full synchronization is announced, the last change wins. */
+	change = json_get(params, "contentChanges");
+	if (change == NULL || change->js_type != JSON_ARRAY)
+		return LSP_INVALID_PARAMS;
+	for (change = change->js_child; change != NULL;
+	    change = change->js_next) {
+		const char *text;
+		size_t len;
+
+		text = json_get_string(change, "text", &len);
+		if (text == NULL || json_get(change, "range") != NULL)
+			return LSP_INVALID_PARAMS;
+		buffer_reset(doc->text);
+		buffer_puts(doc->text, text, len);
+	}
+	return 0;
+}
+
+static int
+lsp_did_close(struct lsp *lsp, const struct json *params,
+    struct buffer *UNUSED(result), struct arena_scope *UNUSED(s))
+{
+	struct lsp_document *doc;
+	const char *uri;
+
+	uri = json_get_string(json_get(params, "textDocument"), "uri", NULL);
+	if (uri == NULL || (doc = MAP_FIND(lsp->documents, uri)) == NULL)
+		return LSP_INVALID_PARAMS;
+	lsp_document_free(doc);
+	MAP_REMOVE(lsp->documents, uri);
+	return 0;
+}
+
+static int
+lsp_formatting(struct lsp *lsp, const struct json *params,
+    struct buffer *result, struct arena_scope *s)
+{
+	return lsp_format(lsp, params, NULL, result, s);
+}
+
+static int
+lsp_range_formatting(struct lsp *lsp, const struct json *params,
+    struct buffer *result, struct arena_scope *s)
+{
+	const struct json *range = json_get(params, "range");
+	const struct json *end = json_get(range, "end");
+	struct diffchunk chunk;
+	unsigned int beg_line, end_character, end_line;
+
+	if (json_get_uint(json_get(range, "start"), "line", &beg_line) ||
+	    json_get_uint(end, "line", &end_line) ||
+	    json_get_uint(end, "character", &end_character) ||
+	    beg_line > end_line || end_line == UINT_MAX)
+		return LSP_INVALID_PARAMS;
+	/*
+	 * Positions are zero based and the end position is exclusive, a range
+	 * ending at the first character of a line does not cover the same line.
+	 */
+	chunk.du_beg = beg_line + 1;
+	chunk.du_end = end_line + 1;
+	if (end_character == 0 && end_line > beg_line)
+		chunk.du_end--;
+	return lsp_format(lsp, params, &chunk, result, s);
+}
+
+static int
+lsp_on_type_formatting(struct lsp *lsp, const struct json *params,
+    struct buffer *result, struct arena_scope *s)
+{
+	struct diffchunk chunk;
+	unsigned int line;
+
+	if (json_get_uint(json_get(params, "position"), "line", &line) ||
+	    line == UINT_MAX)
+		return LSP_INVALID_PARAMS;
+	chunk.du_beg = chunk.du_end = line + 1;
+	return lsp_format(lsp, params, &chunk, result, s);
+}
+
+static struct lsp_document *
+lsp_document_find(struct lsp *lsp, const struct json *params)
+{
+	const char *uri;
+
+	uri = json_get_string(json_get(params, "textDocument"), "uri", NULL);
+	if (uri == NULL)
+		return NULL;
+	return MAP_FIND(lsp->documents, uri);
+}
+
+static void
+lsp_document_free(struct lsp_document *doc)
+{
+	buffer_free(doc->text);
+	free(doc->path);
+}
+
+static int
+lsp_format(struct lsp *lsp, const struct json *params,
+    const struct diffchunk *chunk, struct buffer *result,
+    struct arena_scope *s)
+{
+	VECTOR(struct diffchunk) chunks = NULL;
+	struct options *op = lsp->arg->options;
+	struct arenas *arena = lsp->arg->arena;
+	struct lsp_document *doc;
+	struct buffer *dst;
+	int error;
+
+	doc = lsp_document_find(lsp, params);
+	if (doc == NULL)
+		return LSP_INVALID_PARAMS;
+	if (doc->style == NULL)
+		return LSP_REQUEST_FAILED;
+
+	if (chunk != NULL) {
+		ARENA_VECTOR_INIT(s, chunks, 1);
+		*ARENA_VECTOR_ALLOC(chunks) = *chunk;
+	}
+	dst = arena_buffer_alloc(s, buffer_get_len(doc->text) + 1);
+	op->diffparse = chunks != NULL;
+	arenas_hint(arena, buffer_get_len(doc->text));
+	error = format(&(const struct format_arg){
+	    .path		= doc->path,
+	    .src		= doc->text,
+	    .dst		= dst,
+	    .diff_chunks	= chunks,
+	    .style		= doc->style,
+	    .simple		= lsp->arg->simple,
+	    .options		= op,
+	    .arena		= arena,
+	    .typedefs		= lsp->arg->typedefs,
+	});
+	arenas_hint(arena, 0);
+	op->diffparse = 0;
+	if (error)
+		return LSP_REQUEST_FAILED;
+
+	lsp_edits(doc->text, dst, result, s);
+	return 0;
+}
+
+/*
+ * Emit the edits turning the source code into the formatted source code. Both
+ * are split into lines, the lines common to both are skipped and each
+ * remaining run of lines constitutes an edit.
+ */
+static void
+lsp_edits(const struct buffer *src, const struct buffer *dst,
+    struct buffer *result, struct arena_scope *s)
+{
+	const struct lsp_line *a, *b;
+	size_t i = 0;
+	size_t j = 0;
+	size_t nedits = 0;
+	size_t alen, m, n;
+
+	a = split_lines(src, s);
+	b = split_lines(dst, s);
+	alen = n = VECTOR_LENGTH(a);
+	m = VECTOR_LENGTH(b);
+
+	/* Trim common suffix, avoids bogus edits once the search gives up. */
+	while (n > 0 && m > 0 && line_equal(&a[n - 1], &b[m - 1])) {
+		n--;
+		m--;
+	}
+
+	buffer_putc(result, '[');
+	while (i < n || j < m) {
+		size_t di, dj;
+
+		if (i < n && j < m && line_equal(&a[i], &b[j])) {
+			i++;
+			j++;
+			continue;
+		}
+
+		sync_lines(a, i, n, b, j, m, &di, &dj);
+		if (nedits++ > 0)
+			buffer_putc(result, ',');
+		lsp_edit(result, a, alen, i, i + di, b, j, j + dj);
+		i += di;
+		j += dj;
+	}
+	buffer_putc(result, ']');
+}
+
+static void
+lsp_edit(struct buffer *result, const struct lsp_line *a, size_t alen,
+    size_t abeg, size_t aend, const struct lsp_line *b, size_t bbeg,
+    size_t bend)
+{
+	const char *str = "";
+	size_t len = 0;
+
+	if (bend > bbeg) {
+		str = b[bbeg].ptr;
+		len = (size_t)(b[bend - 1].ptr - str) + b[bend - 1].len;
+	}
+	buffer_printf(result, "{\"range\":{\"start\":");
+	lsp_position(result, a, alen, abeg);
+	buffer_printf(result, ",\"end\":");
+	lsp_position(result, a, alen, aend);
+	buffer_printf(result, "},\"newText\":");
+	json_print_string(result, str, len);
+	buffer_putc(result, '}');
+}
+
+/*
+ * Emit the position of the beginning of the given line. The position beyond
+ * the last line lacking a trailing new line is instead expressed as the end of
+ * the last line, measured in UTF-16 code units.
+ */
+static void
+lsp_position(struct buffer *result, const struct lsp_line *lines, size_t len,
+    size_t lno)
+{
+	unsigned int character = 0;
+
+	if (lno == len && len > 0) {
+		const struct lsp_line *last = &lines[len - 1];
+
+		if (last->ptr[last->len - 1] != '\n') {
+			lno--;
+			character = utf16_len(last->ptr, last->len);
+		}
+	}
+	buffer_printf(result, "{\"line\":%zu,\"character\":%u}",
+	    lno, character);
+}
+
+static struct lsp_line *
+split_lines(const struct buffer *bf, struct arena_scope *s)
+{
+	VECTOR(struct lsp_line) lines;
+	const char *str = buffer_get_ptr(bf);
+	size_t len = buffer_get_len(bf);
+
+	ARENA_VECTOR_INIT(s, lines, 1 << 8);
+	while (len > 0) {
+		struct lsp_line *line;
+		const char *nl;
+
+		line = ARENA_VECTOR_ALLOC(lines);
+		nl = memchr(str, '\n', len);
+		line->ptr = str;
+		line->len = nl != NULL ? (size_t)(nl - str) + 1 : len;
+		line->hash = hash_fnv1a(FNV1A_INIT, str, line->len);
+		str += line->len;
+		len -= line->len;
+	}
+	return lines;
+}
+
+/*
+ * Find the nearest lines common to both the source and formatted source code,
+ * favoring the smallest number of lines in between. Gives up after a while,
+ * causing all remaining lines to be replaced.
+ */
+static void
+sync_lines(const struct lsp_line *a, size_t i, size_t n,
+    const struct lsp_line *b, size_t j, size_t m, size_t *di, size_t *dj)
+{
+	size_t k;
+
+	for (k = 1; k <= LSP_SYNC_MAX; k++) {
+		size_t x;
+
+		for (x = 0; x <= k; x++) {
+			size_t y = k - x;
+
+			if (i + x > n || j + y > m)
+				continue;
+			if ((i + x == n && j + y == m) ||
+			    (i + x < n && j + y < m &&
+			     line_equal(&a[i + x], &b[j + y]))) {
+				*di = x;
+				*dj = y;
+				return;
+			}
+		}
+	}
+	*di = n - i;
+	*dj = m - j;
+}
+
+static int
+line_equal(const struct lsp_line *a, const struct lsp_line *b)
+{
+	return a->hash == b->hash && a->len == b->len &&
+	    memcmp(a->ptr, b->ptr, a->len) == 0;
+}
+
+static unsigned int
+utf16_len(const char *str, size_t len)
+{
+	unsigned int n = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)str[i];
+
+		/* Count leading bytes, surrogate pairs count twice. */
+		if ((c & 0xc0) != 0x80)
+			n++;
+		if (c >= 0xf0)
+			n++;
+	}
+	return n;
+}
+
+/*
+ * Convert file URI to path, other URIs are used verbatim.
+ */
+static char *
+uri_path(const char *uri)
+{
+	static const char scheme[] = "file://";
+	char *path;
+	size_t len = 0;
+
+	if (strncmp(uri, scheme, sizeof(scheme) - 1) != 0) {
+		path = strdup(uri);
+		if (path == NULL)
+			err(1, NULL);
+		return path;
+	}
+
+	uri += sizeof(scheme) - 1;
+	path = malloc(strlen(uri) + 1);
+	if (path == NULL)
+		err(1, NULL);
+	while (*uri != '\0') {
+		if (uri[0] == '%' && isxdigit((unsigned char)uri[1]) &&
+		    isxdigit((unsigned char)uri[2])) {
+			char hex[3] = {uri[1], uri[2], '\0'};
+
+			path[len++] = (char)strtoul(hex, NULL, 16);
+			uri += 3;
+		} else {
+			path[len++] = *uri++;
+		}
+	}
+	path[len] = '\0';
+	return path;
+}
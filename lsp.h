@@ -0,0 +1,16 @@
+struct arenas;
+struct options;
+struct simple;
+struct style_cache;
+struct typedef_index;
+
+struct lsp_arg {
+	struct style_cache	*styles;
+	struct simple		*simple;
+	struct options		*options;
+	struct arenas		*arena;
+	/* Optional typedef names declared in headers. */
+	struct typedef_index	*typedefs;
+};
+
+int	lsp_run(const struct lsp_arg *);
@@ -3,7 +3,9 @@
 #include "config.h"
 
 #include <err.h>
+#include <errno.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 static int	ctotrace(char c);
@@ -12,6 +14,24 @@ void
 options_init(struct options *op)
 {
 	memset(op, 0, sizeof(*op));
+	op->budget = OPTIONS_BUDGET;
+}
+
+int
+options_budget_parse(struct options *op, const char *str)
+{
+	char *end;
+	unsigned long budget;
+
+	errno = 0;
+	budget = strtoul(str, &end, 10);
+	if (str[0] < '0' || str[0] > '9' || *end != '\0' ||
+	    (budget == ULONG_MAX && errno == ERANGE)) {
+		warnx("%s: invalid budget", str);
+		return 1;
+	}
+	op->budget = budget;
+	return 0;
 }
 
 int
@@ -3,16 +3,27 @@
 
 #include "trace-types.h"
 
+/*
+ * Default work budget per root declaration, an order of magnitude above the
+ * largest declarations found in sensible source code while keeping the worst
+ * case latency below a second.
+ */
+#define OPTIONS_BUDGET	(1UL << 26)
+
 struct options {
 	unsigned int	trace[TRACE_MAX];
+	/* Work budget per root declaration, zero denotes no limit. */
+	unsigned long	budget;
 	unsigned int	diff:1,
 			diffparse:1,
+			edit:1,
 			inplace:1,
 			simple:1;
 };
 
 void		options_init(struct options *);
 int		options_trace_parse(struct options *, const char *);
+int		options_budget_parse(struct options *, const char *);
 
 static inline unsigned int
 options_trace_level(const struct options *op, enum trace_type type)
@@ -28,6 +28,14 @@ struct braces_field_arg {
 struct lbrace_cache {
 	int		 valid;
 	struct token	*lbrace;
+
+	/*
+	 * Set if no lbrace was found, along with the first lbrace not
+	 * considered or NULL if there's none. Searching again is futile
+	 * until reaching the line of that lbrace.
+	 */
+	int		 miss;
+	struct token	*miss_lbrace;
 };
 
 static int	parser_braces_with_ruler(struct parser *, struct doc *,
@@ -435,15 +443,17 @@ peek_expr_stop(struct parser *pr, struct lbrace_cache *cache,
 }
 
 static struct token *
-find_next_lbrace(struct parser *pr)
+find_next_lbrace(struct parser *pr, struct token **first)
 {
 	struct lexer_state s;
 	struct lexer *lx = pr->pr_lx;
 	struct token *next_lbrace = NULL;
 	struct token *lbrace, *rbrace;
 
+	*first = NULL;
 	lexer_peek_enter(lx, &s);
 	if (lexer_peek_until(lx, TOKEN_LBRACE, &lbrace)) {
+		*first = lbrace;
 		lexer_seek(lx, lbrace);
 		if (lexer_peek_if_pair(lx, TOKEN_LBRACE, TOKEN_RBRACE, &lbrace, &rbrace) &&
 		    token_cmp(lbrace, rbrace) != 0)
@@ -458,10 +468,20 @@ lbrace_cache_lookup(struct parser *pr, struct lbrace_cache *cache,
     struct token *fallback)
 {
 	if (!cache->valid) {
-		struct token *lbrace = find_next_lbrace(pr);
+		struct token *first, *lbrace, *nx;
+
+		if (cache->miss && (cache->miss_lbrace == NULL ||
+		    (lexer_peek(pr->pr_lx, &nx) &&
+		     token_cmp(nx, cache->miss_lbrace) < 0)))
+			return fallback;
+
+		lbrace = find_next_lbrace(pr, &first);
 		if (lbrace != NULL) {
 			cache->lbrace = lbrace;
 			cache->valid = 1;
+		} else {
+			cache->miss = 1;
+			cache->miss_lbrace = first;
 		}
 	}
 	return cache->lbrace != NULL ? cache->lbrace : fallback;
@@ -12,9 +12,11 @@
 #include "parser-cpp.h"
 #include "parser-expr.h"
 #include "parser-func.h"
+#include "parser-memo.h"
 #include "parser-priv.h"
 #include "parser-stmt-asm.h"
 #include "parser-type.h"
+#include "parser-typedef.h"
 #include "ruler.h"
 #include "simple-decl-forward.h"
 #include "simple-decl.h"
@@ -52,21 +54,27 @@ static int	parser_simple_decl_forward_enter(struct parser *, unsigned int,
 int
 parser_decl_peek(struct parser *pr)
 {
+	struct parser_memo_key key;
 	struct lexer_state s;
 	struct lexer *lx = pr->pr_lx;
 	struct doc *dc;
-	int error, simple;
+	int error, peek, simple;
 
-	arena_scope(pr->pr_arena.doc, doc_scope);
-	parser_arena_scope(&pr->pr_arena_scope.doc, &doc_scope, cookie);
+	if (parser_memo_find(pr, PARSER_MEMO_DECL, 0, &key, &peek, NULL))
+		return peek;
 
-	dc = doc_root(&doc_scope);
+	/* Recognize only, the resulting document is of no interest. */
+	parser_arena_scope(&pr->pr_arena_scope.doc, NULL, cookie);
+
+	dc = doc_root(NULL);
 	lexer_peek_enter(lx, &s);
 	simple = simple_disable(pr->pr_si);
 	error = parser_decl(pr, dc, 0);
 	simple_enable(pr->pr_si, simple);
 	lexer_peek_leave(lx, &s);
-	return error & GOOD;
+	peek = error & GOOD;
+	parser_memo_insert(pr, &key, peek, NULL);
+	return peek;
 }
 
 int
@@ -254,6 +262,7 @@ out:
 		}
 
 		parser_doc_token(pr, semi, concat);
+		parser_typedef_decl(pr, &type, semi);
 
 		if (is_simple_enabled(pr->pr_si, SIMPLE_DECL))
 			simple_decl_semi(pr->pr_simple.decl, semi);
@@ -11,6 +11,7 @@
 #include "parser-priv.h"
 #include "parser-stmt-expr.h"
 #include "parser-type.h"
+#include "parser-typedef.h"
 #include "simple.h"
 #include "token.h"
 
@@ -158,6 +159,17 @@ peek_binary_operator(struct lexer *lx, const struct token *rparen)
 	    (token_has_spaces(op) || token_has_line(op, 1));
 }
 
+/*
+ * Returns non-zero if the given type is a single identifier known to be a type,
+ * in which case a subsequent operator cannot be binary.
+ */
+static int
+is_type_known(const struct parser *pr, const struct parser_type *type)
+{
+	return type->beg == type->end && type->beg->tk_type == TOKEN_IDENT &&
+	    parser_typedef_find(pr, type->beg);
+}
+
 static struct doc *
 expr_recover_cast(const struct expr_exec_arg *UNUSED(ea), void *arg)
 {
@@ -175,7 +187,7 @@ expr_recover_cast(const struct expr_exec_arg *UNUSED(ea), void *arg)
 	    lexer_if(lx, TOKEN_RPAREN, &rparen) &&
 	    !lexer_if(lx, TOKEN_RPAREN, NULL) &&
 	    !lexer_if(lx, TOKEN_COMMA, NULL) &&
-	    !peek_binary_operator(lx, rparen) &&
+	    (is_type_known(pr, &type) || !peek_binary_operator(lx, rparen)) &&
 	    !(lexer_if(lx, TOKEN_AMP, NULL) &&
 	    lexer_if(lx, TOKEN_TILDE, NULL)) &&
 	    !lexer_if(lx, LEXER_EOF, NULL))
@@ -8,6 +8,7 @@
 #include "lexer.h"
 #include "parser-attributes.h"
 #include "parser-decl.h"
+#include "parser-memo.h"
 #include "parser-priv.h"
 #include "parser-stmt.h"
 #include "parser-type.h"
@@ -27,6 +28,8 @@ struct parser_func_proto_arg {
 
 static enum parser_func_peek	parser_func_peek1(struct parser *,
     struct parser_type *);
+static enum parser_func_peek	parser_func_peek2(struct parser *,
+    struct parser_type *);
 
 static int	parser_func_decl1(struct parser *, struct doc *,
     struct ruler *, struct parser_type *);
@@ -51,6 +54,19 @@ parser_func_peek(struct parser *pr)
 
 static enum parser_func_peek
 parser_func_peek1(struct parser *pr, struct parser_type *type)
+{
+	struct parser_memo_key key;
+	int peek;
+
+	if (parser_memo_find(pr, PARSER_MEMO_FUNC, 0, &key, &peek, type))
+		return (enum parser_func_peek)peek;
+	peek = (int)parser_func_peek2(pr, type);
+	parser_memo_insert(pr, &key, peek, type);
+	return (enum parser_func_peek)peek;
+}
+
+static enum parser_func_peek
+parser_func_peek2(struct parser *pr, struct parser_type *type)
 {
 	struct lexer_state s;
 	struct lexer *lx = pr->pr_lx;
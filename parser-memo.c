@@ -0,0 +1,271 @@
+#include "parser-memo.h"
+
+#include "config.h"
+
+#include <err.h>
+
+#include "libks/arena.h"
+#include "libks/map.h"
+
+#include "lexer.h"
+#include "options.h"
+#include "parser-priv.h"
+#include "parser-type.h"
+#include "simple.h"
+#include "timing.h"
+#include "token.h"
+
+struct parser_memo_value {
+	struct parser_type	type;
+	int			peek;
+};
+
+struct parser_memo {
+	MAP(struct parser_memo_key,, struct parser_memo_value)	entries;
+
+	/* Lexer generation the entries are valid for. */
+	unsigned int						generation;
+
+	struct {
+		unsigned long	hit;
+		unsigned long	miss;
+	} stats[PARSER_MEMO_LAST];
+
+	/*
+	 * Last token of statements parsed since the last stamped token, see
+	 * parser_memo_stmt_skip().
+	 */
+	struct {
+		MAP(const struct token *,, struct token *)	end;
+		size_t						len;
+		unsigned long					hit;
+	} stmt;
+};
+
+static void	parser_memo_free(void *);
+
+static const char	*rule_str(enum parser_memo_rule);
+
+struct parser_memo *
+parser_memo_alloc(struct arena_scope *s)
+{
+	struct parser_memo *pm;
+
+	pm = arena_calloc(s, 1, sizeof(*pm));
+	arena_cleanup(s, parser_memo_free, pm);
+	if (MAP_INIT(pm->entries))
+		err(1, NULL);
+	if (MAP_INIT(pm->stmt.end))
+		err(1, NULL);
+	return pm;
+}
+
+static void
+parser_memo_free(void *arg)
+{
+	struct parser_memo *pm = arg;
+
+	MAP_FREE(pm->stmt.end);
+	MAP_FREE(pm->entries);
+}
+
+/*
+ * Invalidate all entries, must be called whenever tokens are mutated without
+ * the lexer noticing such as while branching and recovering.
+ */
+void
+parser_memo_clear(struct parser_memo *pm)
+{
+	MAP_FREE(pm->entries);
+	if (MAP_INIT(pm->entries))
+		err(1, NULL);
+}
+
+void
+parser_memo_trace(const struct parser *pr)
+{
+	const struct parser_memo *pm = pr->pr_memo;
+	enum parser_memo_rule i;
+
+	for (i = 0; i < PARSER_MEMO_LAST; i++) {
+		parser_trace(pr, "%s: hit %lu, miss %lu", rule_str(i),
+		    pm->stats[i].hit, pm->stats[i].miss);
+	}
+	parser_trace(pr, "stmt skip: hit %lu", pm->stmt.hit);
+}
+
+/*
+ * Find the memoized outcome of the given peek rule at the current position.
+ * Returns non-zero on hit. Otherwise, the key must be handed to
+ * parser_memo_insert() once the outcome is known.
+ */
+int
+parser_memo_find(struct parser *pr, enum parser_memo_rule rule,
+    unsigned int flags, struct parser_memo_key *key, int *peek,
+    struct parser_type *type)
+{
+	struct parser_memo *pm = pr->pr_memo;
+	struct lexer *lx = pr->pr_lx;
+	const struct parser_memo_value *val;
+	struct lexer_state st;
+	unsigned int generation;
+
+	/*
+	 * The outcome is not deterministic while an error is pending or if
+	 * simple passes could mutate the token list while peeking.
+	 */
+	if (lexer_get_error(lx) || is_simple_active(pr->pr_si)) {
+		key->rule = PARSER_MEMO_LAST;
+		return 0;
+	}
+
+	generation = lexer_get_generation(lx);
+	if (generation != pm->generation) {
+		parser_memo_clear(pm);
+		pm->generation = generation;
+	}
+
+	st = lexer_get_state(lx);
+	*key = (struct parser_memo_key){
+	    .tk		= st.st_tk,
+	    .rule	= (uint16_t)rule,
+	    .peek	= lexer_get_peek(lx) > 0,
+	    .flags	= flags,
+	};
+	val = MAP_FIND(pm->entries, *key);
+	if (val == NULL) {
+		pm->stats[rule].miss++;
+		return 0;
+	}
+	pm->stats[rule].hit++;
+	if (type != NULL)
+		*type = val->type;
+	*peek = val->peek;
+	return 1;
+}
+
+void
+parser_memo_insert(struct parser *pr, const struct parser_memo_key *key,
+    int peek, const struct parser_type *type)
+{
+	struct parser_memo *pm = pr->pr_memo;
+	struct parser_memo_value *val;
+
+	if (key->rule == PARSER_MEMO_LAST)
+		return;
+	/* Token list mutated while peeking. */
+	if (lexer_get_generation(pr->pr_lx) != pm->generation)
+		return;
+
+	/* Could already be present due to recursion. */
+	if (MAP_FIND(pm->entries, *key) != NULL)
+		return;
+	val = MAP_INSERT(pm->entries, *key);
+	if (val == NULL)
+		err(1, NULL);
+	*val = (struct parser_memo_value){
+	    .type	= type != NULL ? *type : (struct parser_type){0},
+	    .peek	= peek,
+	};
+}
+
+/*
+ * Invalidate all statements, must be called once the parser is about to never
+ * revisit them or while recovering as tokens could be removed.
+ */
+void
+parser_memo_stmt_clear(struct parser_memo *pm)
+{
+	if (pm->stmt.len == 0)
+		return;
+	MAP_FREE(pm->stmt.end);
+	if (MAP_INIT(pm->stmt.end))
+		err(1, NULL);
+	pm->stmt.len = 0;
+}
+
+static int
+is_stmt_memoizable(const struct parser *pr)
+{
+	/*
+	 * Simple passes could mutate the token list and diff mode relies on
+	 * all documents being present in order to detect chunk boundaries.
+	 */
+	return lexer_get_peek(pr->pr_lx) == 0 &&
+	    !lexer_get_error(pr->pr_lx) &&
+	    !is_simple_active(pr->pr_si) &&
+	    !pr->pr_op->diffparse;
+}
+
+/*
+ * While parsing again after branching, everything up to the token unmuting the
+ * output has already been emitted. A statement previously parsed in its
+ * entirety is therefore known to be valid and only have to be skipped, making
+ * the amount of work proportional to the size of the branch as opposed to the
+ * size of the enclosing function. Returns non-zero if the statement at the
+ * current position was skipped.
+ */
+int
+parser_memo_stmt_skip(struct parser *pr)
+{
+	struct parser_memo *pm = pr->pr_memo;
+	struct lexer *lx = pr->pr_lx;
+	struct token **end;
+	struct token *beg, *nx;
+
+	if (pr->pr_token.unmute == NULL || pm->stmt.len == 0 ||
+	    !is_stmt_memoizable(pr))
+		return 0;
+	if (!lexer_peek(lx, &beg))
+		return 0;
+	end = MAP_FIND(pm->stmt.end, beg);
+	if (end == NULL)
+		return 0;
+	/* About to branch again, must be parsed in order to emit mute. */
+	nx = token_next(*end);
+	if (nx == NULL || (nx->tk_flags & TOKEN_FLAG_BRANCH))
+		return 0;
+
+	parser_trace(pr, "skip %s", lexer_serialize(lx, beg));
+	pm->stmt.hit++;
+	timing_count(pr->pr_timing, TIMING_SKIPS, 1);
+	lexer_seek(lx, nx);
+	return 1;
+}
+
+/*
+ * Record the statement starting at the given token and ending at the last
+ * consumed token.
+ */
+void
+parser_memo_stmt_insert(struct parser *pr, const struct token *beg)
+{
+	struct parser_memo *pm = pr->pr_memo;
+	struct token *end;
+
+	if (!is_stmt_memoizable(pr) || !lexer_back(pr->pr_lx, &end))
+		return;
+	if (MAP_FIND(pm->stmt.end, beg) != NULL)
+		return;
+	if (MAP_INSERT_VALUE(pm->stmt.end, beg, end) == NULL)
+		err(1, NULL);
+	pm->stmt.len++;
+}
+
+static const char *
+rule_str(enum parser_memo_rule rule)
+{
+	switch (rule) {
+	case PARSER_MEMO_DECL:
+		return "decl";
+	case PARSER_MEMO_FUNC:
+		return "func";
+	case PARSER_MEMO_STMT:
+		return "stmt";
+	case PARSER_MEMO_TYPE:
+		return "type";
+	case PARSER_MEMO_LAST:
+		break;
+	}
+	return NULL;
+}
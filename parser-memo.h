@@ -0,0 +1,40 @@
+#include <stdint.h>
+
+struct arena_scope;
+struct parser;
+struct parser_type;
+struct token;
+
+enum parser_memo_rule {
+	PARSER_MEMO_DECL,
+	PARSER_MEMO_FUNC,
+	PARSER_MEMO_STMT,
+	PARSER_MEMO_TYPE,
+
+	PARSER_MEMO_LAST, /* sentinel */
+};
+
+/*
+ * Outcome of a peek is determined by the rule, the last consumed token and the
+ * rule specific flags. Fixed width members avoids padding as the whole key is
+ * subject to hashing.
+ */
+struct parser_memo_key {
+	const struct token	*tk;
+	uint16_t		 rule;
+	uint16_t		 peek;
+	uint32_t		 flags;
+};
+
+struct parser_memo	*parser_memo_alloc(struct arena_scope *);
+void			 parser_memo_clear(struct parser_memo *);
+void			 parser_memo_trace(const struct parser *);
+
+int	parser_memo_find(struct parser *, enum parser_memo_rule, unsigned int,
+    struct parser_memo_key *, int *, struct parser_type *);
+void	parser_memo_insert(struct parser *, const struct parser_memo_key *,
+    int, const struct parser_type *);
+
+void	parser_memo_stmt_clear(struct parser_memo *);
+int	parser_memo_stmt_skip(struct parser *);
+void	parser_memo_stmt_insert(struct parser *, const struct token *);
@@ -2,7 +2,11 @@
 #include "trace.h"
 
 struct doc;
+struct parser_memo;
+struct parser_typedef;
+struct timing;
 struct token;
+struct typedef_index;
 
 /*
  * Return values for parser routines. Only one of the following may be returned
@@ -24,6 +28,10 @@ struct parser {
 	const struct style	*pr_st;
 	struct simple		*pr_si;
 	struct clang		*pr_clang;
+	struct parser_memo	*pr_memo;
+	struct parser_typedef	*pr_typedef;
+	struct typedef_index	*pr_typedefs;
+	struct timing		*pr_timing;
 	struct arenas		 pr_arena;
 
 	struct {
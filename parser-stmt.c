@@ -11,6 +11,7 @@
 #include "options.h"
 #include "parser-decl.h"
 #include "parser-expr.h"
+#include "parser-memo.h"
 #include "parser-priv.h"
 #include "parser-stmt-asm.h"
 #include "parser-stmt-expr.h"
@@ -41,6 +42,8 @@ static int	parser_stmt_continue(struct parser *, struct doc *);
 static int	parser_stmt_return(struct parser *, struct doc *);
 static int	parser_stmt_semi(struct parser *, struct doc *);
 static int	parser_stmt_cpp(struct parser *, struct doc *);
+static int	parser_stmt_resume(struct parser *, struct doc *,
+    unsigned int);
 
 static int		 parser_simple_stmt_enter(struct parser *,
     struct simple_cookie *);
@@ -55,17 +58,27 @@ static int		 peek_simple_stmt(struct parser *);
 int
 parser_stmt_peek(struct parser *pr)
 {
+	struct parser_memo_key key;
+	struct lexer_state s;
+	struct lexer *lx = pr->pr_lx;
 	struct doc *dc;
-	int error, simple;
+	int error, peek, simple;
 
-	arena_scope(pr->pr_arena.doc, doc_scope);
-	parser_arena_scope(&pr->pr_arena_scope.doc, &doc_scope, cookie);
+	if (parser_memo_find(pr, PARSER_MEMO_STMT, 0, &key, &peek, NULL))
+		return peek;
 
-	dc = doc_root(&doc_scope);
+	/* Recognize only, the resulting document is of no interest. */
+	parser_arena_scope(&pr->pr_arena_scope.doc, NULL, cookie);
+
+	dc = doc_root(NULL);
+	lexer_peek_enter(lx, &s);
 	simple = simple_disable(pr->pr_si);
 	error = parser_stmt1(pr, dc);
 	simple_enable(pr->pr_si, simple);
-	return error & GOOD;
+	lexer_peek_leave(lx, &s);
+	peek = error & GOOD;
+	parser_memo_insert(pr, &key, peek, NULL);
+	return peek;
 }
 
 static int
@@ -202,7 +215,7 @@ parser_stmt_block(struct parser *pr, struct parser_stmt_block_arg *arg)
 		line = doc_literal(" ", indent);
 	if (!lexer_peek(lx, &pv))
 		return parser_fail(pr);
-	while ((error = parser_stmt(pr, indent)) & GOOD) {
+	while ((error = parser_stmt_resume(pr, indent, arg->flags)) & GOOD) {
 		nstmt++;
 		if (lexer_peek(lx, &tk) && tk == rbrace)
 			break;
@@ -275,6 +288,28 @@ has_if_stmt_braces(struct parser *pr, int elseif)
 	return peek;
 }
 
+/*
+ * Parse a statement inside a block, which is the finest boundary at which
+ * parsing can resume after branching.
+ */
+static int
+parser_stmt_resume(struct parser *pr, struct doc *dc, unsigned int flags)
+{
+	struct token *beg;
+	int error;
+
+	if ((flags & PARSER_STMT_BLOCK_EXPR_GNU) ||
+	    !lexer_peek(pr->pr_lx, &beg))
+		return parser_stmt(pr, dc);
+
+	if (parser_memo_stmt_skip(pr))
+		return parser_good(pr);
+	error = parser_stmt(pr, dc);
+	if (error & GOOD)
+		parser_memo_stmt_insert(pr, beg);
+	return error;
+}
+
 static int
 parser_stmt_if(struct parser *pr, struct doc *dc)
 {
@@ -10,7 +10,9 @@
 #include "parser-cpp.h"
 #include "parser-expr.h"
 #include "parser-func.h"
+#include "parser-memo.h"
 #include "parser-priv.h"
+#include "parser-typedef.h"
 #include "ruler.h"
 #include "simple-implicit-int.h"
 #include "simple-static.h"
@@ -18,9 +20,13 @@
 #include "style.h"
 #include "token.h"
 
+static int	parser_type_peek1(struct parser *, struct parser_type *,
+    unsigned int);
+
 static int	peek_type_func_ptr(struct lexer *, struct token **,
     struct token **);
 static int	peek_type_ident_after_type(struct parser *);
+static int	peek_type_known(struct parser *, const struct token *);
 static int	peek_type_ptr_array(struct lexer *, struct token **);
 static int	peek_type_noident(struct lexer *, struct token **);
 static int	peek_type_unknown_array(struct lexer *, struct token **);
@@ -30,6 +36,27 @@ static int	peek_type_squares(struct lexer *, struct token **);
 int
 parser_type_peek(struct parser *pr, struct parser_type *type,
     unsigned int flags)
+{
+	struct parser_memo_key key;
+	struct parser_type tmp;
+	int peek;
+
+	if (parser_memo_find(pr, PARSER_MEMO_TYPE, flags, &key, &peek, &tmp)) {
+		if (peek && type != NULL)
+			*type = tmp;
+		return peek;
+	}
+
+	peek = parser_type_peek1(pr, &tmp, flags);
+	parser_memo_insert(pr, &key, peek, &tmp);
+	if (peek && type != NULL)
+		*type = tmp;
+	return peek;
+}
+
+static int
+parser_type_peek1(struct parser *pr, struct parser_type *type,
+    unsigned int flags)
 {
 	struct lexer *lx = pr->pr_lx;
 	struct lexer_state s;
@@ -59,7 +86,7 @@ parser_type_peek(struct parser *pr, struct parser_type *type,
 
 	lexer_peek_enter(lx, &s);
 	for (;;) {
-		struct token *rparen, *rsquare;
+		struct token *ident, *rparen, *rsquare;
 
 		if (lexer_peek_if(lx, LEXER_EOF, NULL))
 			break;
@@ -90,9 +117,16 @@ parser_type_peek(struct parser *pr, struct parser_type *type,
 				return 0;
 			end = rparen;
 			peek = 1;
-		} else if (lexer_peek_if(lx, TOKEN_IDENT, NULL)) {
-			/* Ensure this is not the identifier after the type. */
-			if ((flags & PARSER_TYPE_CAST) == 0 &&
+		} else if (lexer_peek_if(lx, TOKEN_IDENT, &ident)) {
+			/*
+			 * Ensure this is not the identifier after the type.
+			 * A known type name not preceded by another type
+			 * cannot be, no need to speculate.
+			 */
+			int known = !peek && peek_type_known(pr, ident);
+
+			if (!known &&
+			    (flags & PARSER_TYPE_CAST) == 0 &&
 			    (flags & PARSER_TYPE_EXPR) == 0 &&
 			    peek_type_ident_after_type(pr))
 				break;
@@ -101,10 +135,10 @@ parser_type_peek(struct parser *pr, struct parser_type *type,
 			if (!lexer_if(lx, TOKEN_IDENT, &end))
 				return 0;
 			/*
-			 * Preceding storage/qualifier followed by identifier,
-			 * treat it as a type.
+			 * Preceding storage/qualifier followed by identifier or
+			 * known type name, treat it as a type.
 			 */
-			if (nkeywords > 0)
+			if (nkeywords > 0 || known)
 				peek = 1;
 		} else if (ntokens > 0 && peek_type_func_ptr(lx, &args, &end)) {
 			if (!lexer_back(lx, &align))
@@ -397,6 +431,32 @@ peek_type_ident_after_type(struct parser *pr)
 	return peek;
 }
 
+/*
+ * Returns non-zero if the given identifier is a known type name followed by a
+ * token that can start a declarator. Otherwise, the identifier could be a
+ * variable shadowing the type name.
+ */
+static int
+peek_type_known(struct parser *pr, const struct token *ident)
+{
+	struct lexer *lx = pr->pr_lx;
+	struct lexer_state s;
+	int peek = 0;
+
+	if (!parser_typedef_find(pr, ident))
+		return 0;
+
+	lexer_peek_enter(lx, &s);
+	if (lexer_if(lx, TOKEN_IDENT, NULL) &&
+	    (lexer_if(lx, TOKEN_IDENT, NULL) ||
+	     lexer_if(lx, TOKEN_STAR, NULL) ||
+	     (lexer_if(lx, TOKEN_LPAREN, NULL) &&
+	      lexer_if(lx, TOKEN_STAR, NULL))))
+		peek = 1;
+	lexer_peek_leave(lx, &s);
+	return peek;
+}
+
 static int
 peek_type_noident(struct lexer *lx, struct token **tk)
 {
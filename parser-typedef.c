@@ -0,0 +1,136 @@
+#include "parser-typedef.h"
+
+#include "config.h"
+
+#include <err.h>
+
+#include "libks/arena.h"
+#include "libks/map.h"
+
+#include "lexer.h"
+#include "parser-priv.h"
+#include "parser-type.h"
+#include "token.h"
+#include "typedef-index.h"
+
+/*
+ * Names introduced by typedef declarations, allowing identifiers to be
+ * recognized as types without any speculation. Tags are not recorded as they
+ * are always preceded by struct, union or enum.
+ */
+struct parser_typedef {
+	MAP(const char, *, int)	names;
+};
+
+static void	parser_typedef_free(void *);
+static void	parser_typedef_insert(struct parser_typedef *,
+    const struct token *);
+
+struct parser_typedef *
+parser_typedef_alloc(struct arena_scope *s)
+{
+	struct parser_typedef *pt;
+
+	pt = arena_calloc(s, 1, sizeof(*pt));
+	arena_cleanup(s, parser_typedef_free, pt);
+	if (MAP_INIT(pt->names))
+		err(1, NULL);
+	return pt;
+}
+
+static void
+parser_typedef_free(void *arg)
+{
+	struct parser_typedef *pt = arg;
+
+	MAP_FREE(pt->names);
+}
+
+/*
+ * Record the names declared by the given typedef declaration, ending with the
+ * given semicolon. Declarations parsed while peeking are ignored as they could
+ * be discarded.
+ */
+void
+parser_typedef_decl(struct parser *pr, const struct parser_type *type,
+    const struct token *semi)
+{
+	const struct token *tk;
+	int depth = 0;
+	int istypedef = 0;
+
+	if (lexer_get_peek(pr->pr_lx))
+		return;
+
+	for (tk = type->beg; tk != type->end; tk = token_next(tk)) {
+		if (tk->tk_type == TOKEN_TYPEDEF) {
+			istypedef = 1;
+			break;
+		}
+	}
+	if (!istypedef)
+		return;
+
+	/* Function pointer, the name is part of the type. */
+	if (type->args != NULL) {
+		const struct token *name = NULL;
+
+		for (tk = type->beg; tk != type->args; tk = token_next(tk)) {
+			if (tk->tk_type == TOKEN_IDENT)
+				name = tk;
+		}
+		if (name != NULL)
+			parser_typedef_insert(pr->pr_typedef, name);
+		return;
+	}
+
+	for (tk = token_next(type->end); tk != NULL && tk != semi;
+	    tk = token_next(tk)) {
+		const struct token *nx;
+
+		switch (tk->tk_type) {
+		case TOKEN_LBRACE:
+		case TOKEN_LPAREN:
+		case TOKEN_LSQUARE:
+			depth++;
+			continue;
+		case TOKEN_RBRACE:
+		case TOKEN_RPAREN:
+		case TOKEN_RSQUARE:
+			depth--;
+			continue;
+		case TOKEN_IDENT:
+			break;
+		default:
+			continue;
+		}
+		if (depth > 0)
+			continue;
+
+		nx = token_next(tk);
+		if (nx != NULL && (nx->tk_type == TOKEN_COMMA ||
+		    nx->tk_type == TOKEN_SEMI || nx->tk_type == TOKEN_LSQUARE))
+			parser_typedef_insert(pr->pr_typedef, tk);
+	}
+}
+
+/*
+ * Returns non-zero if the given identifier is known to be a type, either
+ * declared in the same file or in any indexed header.
+ */
+int
+parser_typedef_find(const struct parser *pr, const struct token *tk)
+{
+	return MAP_FIND_N(pr->pr_typedef->names, tk->tk_str, tk->tk_len) !=
+	    NULL ||
+	    typedef_index_find(pr->pr_typedefs, tk->tk_str, tk->tk_len);
+}
+
+static void
+parser_typedef_insert(struct parser_typedef *pt, const struct token *tk)
+{
+	if (MAP_FIND_N(pt->names, tk->tk_str, tk->tk_len) != NULL)
+		return;
+	if (MAP_INSERT_N(pt->names, tk->tk_str, tk->tk_len) == NULL)
+		err(1, NULL);
+}
@@ -0,0 +1,10 @@
+struct arena_scope;
+struct parser;
+struct parser_type;
+struct token;
+
+struct parser_typedef	*parser_typedef_alloc(struct arena_scope *);
+
+void	parser_typedef_decl(struct parser *, const struct parser_type *,
+    const struct token *);
+int	parser_typedef_find(const struct parser *, const struct token *);
@@ -2,6 +2,7 @@
 
 #include "config.h"
 
+#include <err.h>
 #include <string.h>
 
 #include "libks/arena-buffer.h"
@@ -16,11 +17,21 @@
 #include "parser-decl.h"
 #include "parser-extern.h"
 #include "parser-func.h"
+#include "parser-memo.h"
 #include "parser-priv.h"
 #include "parser-stmt-asm.h"
+#include "parser-typedef.h"
+#include "timing.h"
 #include "token.h"
 #include "trace-types.h"
 
+static int	parser_exec_budget(const struct parser *);
+static int	parser_exec_verbatim(struct parser *, struct doc *,
+    struct token *);
+
+static struct token	*decl_end(struct token *, int);
+static unsigned int	 token_first_line(struct token *);
+
 static void
 clang_format_verbatim(struct parser *pr, struct doc *dc, unsigned int end)
 {
@@ -94,6 +105,10 @@ parser_alloc(const struct parser_arg *arg, struct arena_scope *s)
 	pr->pr_si = arg->simple;
 	pr->pr_lx = arg->lexer;
 	pr->pr_clang = arg->clang;
+	pr->pr_memo = parser_memo_alloc(s);
+	pr->pr_typedef = parser_typedef_alloc(s);
+	pr->pr_typedefs = arg->typedefs;
+	pr->pr_timing = arg->timing;
 	pr->pr_arena = *arg->arena;
 
 	return pr;
@@ -103,10 +118,14 @@ int
 parser_exec(struct parser *pr, const struct diffchunk *diff_chunks,
     struct buffer *bf)
 {
+	struct doc_exec_stats stats = {0};
 	struct doc *dc;
 	struct clang *clang = pr->pr_clang;
 	struct lexer *lx = pr->pr_lx;
+	struct timing *ti = pr->pr_timing;
+	unsigned long budget;
 	unsigned int doc_flags = 0;
+	int nobudget = 0;
 	int error = 0;
 
 	arena_scope(pr->pr_arena.doc, doc_scope);
@@ -114,9 +133,15 @@ parser_exec(struct parser *pr, const struct diffchunk *diff_chunks,
 
 	dc = doc_root(&doc_scope);
 
+	timing_enter(ti, TIMING_PARSER);
 	for (;;) {
 		struct doc *concat;
-		struct token *tk;
+		struct token *beg, *tk;
+
+		budget = !nobudget && parser_exec_budget(pr) ?
+		    pr->pr_op->budget : 0;
+		lexer_budget_reset(lx, budget);
+		nobudget = 0;
 
 		/* Always emit EOF token as it could have prefixes. */
 		if (lexer_if(lx, LEXER_EOF, &tk)) {
@@ -128,13 +153,34 @@ parser_exec(struct parser *pr, const struct diffchunk *diff_chunks,
 
 		concat = doc_alloc(DOC_CONCAT, dc);
 
+		if (!lexer_peek(lx, &beg)) {
+			error = 1;
+			break;
+		}
 		error = parser_root(pr, concat);
-		if (error & GOOD) {
+		/* Account for fit checks and minimizers, see doc_exec(). */
+		if (budget > 0 && (error & GOOD))
+			(void)lexer_budget_spend(lx, doc_cost(concat));
+		if (lexer_budget_exhausted(lx)) {
+			/*
+			 * Favor verbatim emission, otherwise parse the same
+			 * declaration again without any budget.
+			 */
+			doc_remove_tail(dc);
+			parser_memo_stmt_clear(pr->pr_memo);
+			parser_reset(pr);
+			lexer_budget_reset(lx, 0);
+			lexer_seek(lx, beg);
+			if (!parser_exec_verbatim(pr, dc, beg))
+				nobudget = 1;
+		} else if (error & GOOD) {
 			clang_stamp(clang, lx);
+			parser_memo_stmt_clear(pr->pr_memo);
 		} else if (error & BRCH) {
 			if (!clang_branch(clang, lx, &pr->pr_token.unmute))
 				break;
 			parser_reset(pr);
+			timing_count(ti, TIMING_BRANCHES, 1);
 		} else if (error & (FAIL | NONE)) {
 			int r;
 
@@ -143,15 +189,21 @@ parser_exec(struct parser *pr, const struct diffchunk *diff_chunks,
 				break;
 			while (r-- > 0)
 				doc_remove_tail(dc);
+			parser_memo_stmt_clear(pr->pr_memo);
 			parser_reset(pr);
+			timing_count(ti, TIMING_RECOVERS, 1);
 		}
 	}
+	lexer_budget_reset(lx, 0);
 	if (error) {
+		timing_leave(ti, TIMING_PARSER);
 		lexer_error_flush(lx);
 		return 1;
 	}
 
 	clang_format_verbatim(pr, dc, 0);
+	parser_memo_trace(pr);
+	timing_leave(ti, TIMING_PARSER);
 
 	if (pr->pr_op->diffparse)
 		doc_flags |= DOC_EXEC_DIFF;
@@ -159,6 +211,7 @@ parser_exec(struct parser *pr, const struct diffchunk *diff_chunks,
 		doc_flags |= DOC_EXEC_TRIM;
 	if (options_trace_level(pr->pr_op, TRACE_DOC) > 0)
 		doc_flags |= DOC_EXEC_TRACE;
+	timing_enter(ti, TIMING_DOC);
 	doc_exec(&(struct doc_exec_arg){
 	    .dc			= dc,
 	    .lx			= pr->pr_op->diffparse ? pr->pr_lx : NULL,
@@ -166,12 +219,83 @@ parser_exec(struct parser *pr, const struct diffchunk *diff_chunks,
 	    .diff_chunks	= pr->pr_op->diffparse ? diff_chunks : NULL,
 	    .bf			= bf,
 	    .st			= pr->pr_st,
+	    .stats		= ti != NULL ? &stats : NULL,
 	    .flags		= doc_flags,
 	});
+	timing_leave(ti, TIMING_DOC);
+	timing_count(ti, TIMING_DOCS, stats.ndocs);
+	timing_count(ti, TIMING_NFITS, stats.nfits);
+	timing_count(ti, TIMING_MINIMIZERS, stats.nminimizers);
 
 	return 0;
 }
 
+/*
+ * Returns non-zero if the work budget can be honored for the next root
+ * declaration. Not applicable while any output is muted as the declaration
+ * cannot be emitted verbatim, nor in diff mode as verbatim emission is
+ * already subject to the diff chunks.
+ */
+static int
+parser_exec_budget(const struct parser *pr)
+{
+	return !pr->pr_op->diffparse &&
+	    pr->pr_token.unmute == NULL &&
+	    pr->pr_token.clang_format_off == NULL;
+}
+
+/*
+ * Emit the root declaration starting at the given token verbatim after
+ * exhausting the work budget. Returns non-zero on success.
+ */
+static int
+parser_exec_verbatim(struct parser *pr, struct doc *dc, struct token *beg)
+{
+	struct lexer *lx = pr->pr_lx;
+	struct token *end, *nx, *pv, *verbatim;
+	const char *str;
+	size_t len;
+	unsigned int lbeg, lend;
+
+	end = decl_end(beg, parser_func_peek(pr) == PARSER_FUNC_PEEK_IMPL);
+	nx = token_next(end);
+	if (nx == NULL)
+		return 0;
+
+	/* Lines must not be shared with surrounding declarations. */
+	lbeg = token_first_line(beg);
+	pv = token_prev(beg);
+	if (pv != NULL && pv->tk_lno >= lbeg)
+		return 0;
+	if (nx->tk_type == LEXER_EOF && !token_has_prefixes(nx)) {
+		lend = 0;
+	} else {
+		lend = token_first_line(nx);
+		if (lend <= end->tk_lno)
+			return 0;
+	}
+	if (!lexer_get_lines(lx, lbeg, lend, &str, &len))
+		return 0;
+
+	warnx("%s:%u: work budget exhausted, declaration emitted verbatim",
+	    lexer_get_path(lx), beg->tk_lno);
+	parser_trace(pr, "verbatim [%s, %s]",
+	    lexer_serialize(lx, beg), lexer_serialize(lx, end));
+
+	verbatim = lexer_emit_synthetic(lx, &(struct token){
+	    .tk_type	= TOKEN_LITERAL,
+	    .tk_str	= str,
+	    .tk_len	= len,
+	});
+	doc_token(verbatim, doc_alloc(DOC_CONCAT, dc), DOC_VERBATIM,
+	    __func__, __LINE__);
+	token_rele(verbatim);
+
+	lexer_seek(lx, nx);
+	clang_stamp(pr->pr_clang, lx);
+	return 1;
+}
+
 int
 parser_root(struct parser *pr, struct doc *dc)
 {
@@ -254,6 +378,11 @@ parser_width(struct parser *pr, const struct doc *dc)
 {
 	struct buffer *bf;
 
+	if (doc_is_sink(dc))
+		return 0;
+	/* Accounted for as a fit check. */
+	(void)lexer_budget_spend(pr->pr_lx, 1);
+
 	arena_scope(pr->pr_arena.buffer, s);
 
 	bf = arena_buffer_alloc(&s, 1 << 10);
@@ -287,6 +416,7 @@ parser_reset(struct parser *pr)
 	struct token *nx;
 
 	lexer_error_reset(pr->pr_lx);
+	parser_memo_clear(pr->pr_memo);
 
 	/* Remove last clang-format off if about to be traversed again. */
 	if (pr->pr_token.clang_format_off != NULL &&
@@ -304,6 +434,9 @@ parser_doc_token_impl(struct parser *pr, struct token *tk, struct doc *dc,
 	struct doc *out;
 	struct token *nx, *prefix, *suffix;
 
+	/* Accounted for as a document node. */
+	(void)lexer_budget_spend(pr->pr_lx, 1);
+
 	if (tk == pr->pr_token.unmute) {
 		if (!lexer_get_peek(pr->pr_lx))
 			pr->pr_token.unmute = NULL;
@@ -383,3 +516,54 @@ parser_arena_scope_leave(struct parser_arena_scope_cookie *cookie)
 {
 	*cookie->restore_scope = cookie->old_scope;
 }
+
+/*
+ * Returns the last token of the root declaration starting at the given token,
+ * which is either a semicolon or the right brace of a function implementation
+ * outside of any nesting.
+ */
+static struct token *
+decl_end(struct token *beg, int func)
+{
+	struct token *tk = beg;
+	int depth = 0;
+
+	for (;;) {
+		struct token *nx;
+
+		switch (tk->tk_type) {
+		case TOKEN_LBRACE:
+		case TOKEN_LPAREN:
+		case TOKEN_LSQUARE:
+			depth++;
+			break;
+		case TOKEN_RBRACE:
+		case TOKEN_RPAREN:
+		case TOKEN_RSQUARE:
+			if (depth > 0)
+				depth--;
+			if (depth == 0 && func && tk->tk_type == TOKEN_RBRACE)
+				return tk;
+			break;
+		case TOKEN_SEMI:
+			/* Could be a K&R argument declaration. */
+			if (depth == 0 && !func)
+				return tk;
+			break;
+		}
+
+		nx = token_next(tk);
+		if (nx == NULL || nx->tk_type == LEXER_EOF)
+			return tk;
+		tk = nx;
+	}
+}
+
+static unsigned int
+token_first_line(struct token *tk)
+{
+	struct token *prefix;
+
+	prefix = token_list_first(&tk->tk_prefixes);
+	return prefix != NULL ? prefix->tk_lno : tk->tk_lno;
+}
@@ -1,6 +1,7 @@
 struct arena_scope;
 struct buffer;
 struct diffchunk;
+struct typedef_index;
 
 struct parser_arg {
 	struct lexer		*lexer;
@@ -9,6 +10,10 @@ struct parser_arg {
 	struct simple		*simple;
 	struct clang		*clang;
 	struct arenas		*arena;
+	/* Optional per phase timing, see timing_alloc(). */
+	struct timing		*timing;
+	/* Optional typedef names declared in headers. */
+	struct typedef_index	*typedefs;
 };
 
 struct parser	*parser_alloc(const struct parser_arg *, struct arena_scope *);
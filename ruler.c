@@ -14,11 +14,30 @@
 #include "token.h"
 #include "util.h"
 
+/*
+ * Statistics of all datums in the column are maintained while inserting,
+ * allowing the column length to be calculated without visiting each datum.
+ */
 struct ruler_column {
 	VECTOR(struct ruler_datum)	rc_datums;
 	size_t				rc_len;
 	size_t				rc_nspaces;
 	size_t				rc_ntabs;
+	/* Index of the first datum with the largest length. */
+	size_t				rc_longest;
+	/* Largest amount of spaces among the datums with the largest length. */
+	unsigned int			rc_longest_nspaces;
+	/* Largest amount of trailing spaces after datums using tabs. */
+	unsigned int			rc_tabs_nspaces;
+
+	/* Existing alignment of all datums, see sense_column_length(). */
+	struct {
+		/* Column of the next token plus the datum spaces. */
+		unsigned int	width;
+		/* Largest datum width. */
+		unsigned int	datum_width;
+		int		invalid;
+	} rc_sense;
 };
 
 struct ruler_indent {
@@ -42,6 +61,8 @@ struct ruler_length {
 static void	ruler_exec_indent(struct ruler *);
 static void	ruler_reset(struct ruler *);
 
+static void		sense_datum(struct ruler_column *,
+    const struct ruler_datum *);
 static unsigned int	sense_column_length(struct ruler_column *);
 static int		ruler_column_length(const struct ruler *,
     struct ruler_column *, struct ruler_length *);
@@ -84,6 +105,10 @@ ruler_insert_impl(struct ruler *rl, struct token *tk, struct doc *dc,
 	struct ruler_column *rc;
 	struct ruler_datum *rd;
 
+	/* Nothing to align while recognizing, see doc_root(). */
+	if (doc_is_sink(dc))
+		return;
+
 	while (VECTOR_LENGTH(rl->rl_columns) < col) {
 		rc = ARENA_VECTOR_CALLOC(rl->rl_columns);
 		ARENA_VECTOR_INIT(rl->rl_arena.ruler_scope, rc->rc_datums,
@@ -98,12 +123,32 @@ ruler_insert_impl(struct ruler *rl, struct token *tk, struct doc *dc,
 	rd->rd_len = len;
 	rd->rd_nspaces = nspaces;
 
+	if (VECTOR_LENGTH(rc->rc_datums) == 1 || rd->rd_len > rc->rc_len) {
+		rc->rc_longest = VECTOR_LENGTH(rc->rc_datums) - 1;
+		rc->rc_longest_nspaces = rd->rd_nspaces;
+	} else if (rd->rd_len == rc->rc_len &&
+	    rd->rd_nspaces > rc->rc_longest_nspaces) {
+		rc->rc_longest_nspaces = rd->rd_nspaces;
+	}
 	if (rd->rd_len > rc->rc_len)
 		rc->rc_len = rd->rd_len;
 	if (rd->rd_nspaces > rc->rc_nspaces)
 		rc->rc_nspaces = rd->rd_nspaces;
-	if (token_has_tabs(tk))
+	if (token_has_tabs(tk)) {
+		struct token *suffix;
+
 		rc->rc_ntabs++;
+		suffix = token_find_suffix_spaces(tk);
+		if (suffix != NULL) {
+			unsigned int n;
+
+			n = count_trailing_spaces(suffix->tk_str,
+			    suffix->tk_len);
+			if (n > rc->rc_tabs_nspaces)
+				rc->rc_tabs_nspaces = n;
+		}
+	}
+	sense_datum(rc, rd);
 }
 
 /*
@@ -257,100 +302,73 @@ static unsigned int
 sense_column_spaces(const struct ruler_column *rc)
 {
 	unsigned int nspaces = rc->rc_nspaces;
-	unsigned int i;
-
-	if (rc->rc_ntabs == 0)
-		return nspaces;
-
-	for (i = 0; i < VECTOR_LENGTH(rc->rc_datums); i++) {
-		const struct ruler_datum *rd = &rc->rc_datums[i];
-		struct token *suffix;
-		unsigned int n;
-
-		if (!token_has_tabs(rd->rd_tk))
-			continue;
-		suffix = token_find_suffix_spaces(rd->rd_tk);
-		if (suffix == NULL)
-			continue;
-
-		n = count_trailing_spaces(suffix->tk_str,
-		    suffix->tk_len);
-		if (n > nspaces)
-			nspaces = n;
-	}
 
+	if (rc->rc_ntabs > 0 && rc->rc_tabs_nspaces > nspaces)
+		nspaces = rc->rc_tabs_nspaces;
 	return nspaces;
 }
 
-static unsigned int
-sense_datum_width(const struct ruler_datum *rd, unsigned int nspaces)
+/*
+ * Record the existing alignment of the given datum. The column is only
+ * considered aligned if all datums are followed by a token on the same line
+ * positioned at the same column, once adjusted for the amount of spaces.
+ */
+static void
+sense_datum(struct ruler_column *rc, const struct ruler_datum *rd)
 {
 	const struct token *tk = rd->rd_tk;
 	const struct token *nx;
-	unsigned int alignment_width, datum_width;
+	unsigned int datum_width, width;
 
-	if (token_has_suffix(tk, TOKEN_COMMENT))
-		return 0;
+	if (rc->rc_sense.invalid)
+		return;
 
 	nx = token_next(tk);
-	if (nx == NULL || token_cmp(tk, nx) != 0)
-		return 0;
+	if (token_has_suffix(tk, TOKEN_COMMENT) ||
+	    nx == NULL || token_cmp(tk, nx) != 0) {
+		rc->rc_sense.invalid = 1;
+		return;
+	}
+
 	/*
 	 * <tab> struct sss <tab> <space> *
 	 * ^datum_width---^             | |
-	 * ^alignment_width-------------^ |
+	 * ^width-----------------------^ |
 	 * ^nx->tk_cno--------------------^
 	 */
+	width = nx->tk_cno + rd->rd_nspaces;
 	datum_width = colwidth(tk->tk_str, tk->tk_len, tk->tk_cno);
-	alignment_width = nx->tk_cno - (nspaces - rd->rd_nspaces);
-	if (datum_width >= alignment_width)
-		return 0;
-	return alignment_width;
-}
-
-static const struct ruler_datum *
-sense_column_longest_datum(const struct ruler_column *rc)
-{
-	const struct ruler_datum *rd = NULL;
-	unsigned int i;
-
-	for (i = 0; i < VECTOR_LENGTH(rc->rc_datums); i++) {
-		const struct ruler_datum *candidate = &rc->rc_datums[i];
-		if (rd == NULL || candidate->rd_len > rd->rd_len)
-			rd = candidate;
+	if (VECTOR_LENGTH(rc->rc_datums) == 1) {
+		rc->rc_sense.width = width;
+	} else if (width != rc->rc_sense.width) {
+		rc->rc_sense.invalid = 1;
+		return;
 	}
-	assert(rd != NULL);
-
-	return rd;
+	if (datum_width > rc->rc_sense.datum_width)
+		rc->rc_sense.datum_width = datum_width;
 }
 
 static unsigned int
 sense_column_length(struct ruler_column *rc)
 {
-	size_t i;
-	unsigned int alignment_width, effective_nspaces, effective_width, len, width;
+	const struct ruler_datum *longest_datum;
+	const struct token *tk;
+	unsigned int alignment_width, effective_nspaces, effective_width, width;
 
 	assert(!VECTOR_EMPTY(rc->rc_datums));
 
-	effective_nspaces = sense_column_spaces(rc);
+	if (rc->rc_sense.invalid)
+		return 0;
 
 	/*
-	 * Since all datums are expected to be of same width, operate on the
-	 * first one.
+	 * All datums share the same alignment, ensure that it is wide enough
+	 * to fit all datums.
 	 */
-	effective_width = sense_datum_width(&rc->rc_datums[0],
-	    effective_nspaces);
-	if (effective_width == 0)
+	effective_nspaces = sense_column_spaces(rc);
+	effective_width = rc->rc_sense.width - effective_nspaces;
+	if (rc->rc_sense.datum_width >= effective_width)
 		return 0;
 
-	for (i = 0; i < VECTOR_LENGTH(rc->rc_datums); i++) {
-		struct ruler_datum *rd = &rc->rc_datums[i];
-
-		width = sense_datum_width(rd, effective_nspaces);
-		if (width == 0 || width != effective_width)
-			return 0;
-	}
-
 	/* Commit potentially changed number of spaces. */
 	rc->rc_nspaces = effective_nspaces;
 
@@ -363,13 +381,11 @@ sense_column_length(struct ruler_column *rc)
 	 * ^width---------^             |
 	 * ^effective_width-------------^
 	 */
-	const struct ruler_datum *longest_datum =
-	    sense_column_longest_datum(rc);
-	const struct token *tk = longest_datum->rd_tk;
+	longest_datum = &rc->rc_datums[rc->rc_longest];
+	tk = longest_datum->rd_tk;
 	width = colwidth(tk->tk_str, tk->tk_len, tk->tk_cno);
 	alignment_width = effective_width - width;
-	len = longest_datum->rd_len + alignment_width;
-	return len;
+	return longest_datum->rd_len + alignment_width;
 }
 
 static int
@@ -417,33 +433,16 @@ count_trailing_spaces(const char *str, size_t len)
 	return nspaces;
 }
 
+/*
+ * If the number of spaces required for the longest datum with smallest amount
+ * of spaces is less than the maximum amount of spaces, other datums will
+ * overlap.
+ */
 static int
 minimize(const struct ruler_column *rc)
 {
-	size_t i;
-	unsigned int minspaces = UINT_MAX;
-
 	if (VECTOR_LENGTH(rc->rc_datums) < 2 ||
 	    rc->rc_nspaces == 0 || rc->rc_len % 8 > 0)
 		return 0;
-
-	/* Find the longest datum with the smallest amount of spaces. */
-	for (i = 0; i < VECTOR_LENGTH(rc->rc_datums); i++) {
-		const struct ruler_datum *rd = &rc->rc_datums[i];
-		unsigned int nspaces;
-
-		if (rd->rd_len < rc->rc_len)
-			continue;
-
-		nspaces = rc->rc_nspaces - rd->rd_nspaces;
-		if (minspaces == UINT_MAX || nspaces < minspaces)
-			minspaces = nspaces;
-	}
-
-	/*
-	 * If the number of spaces required for the longest datum with smallest
-	 * amount of spaces is less than the maximum amount of spaces, other
-	 * datums will overlap.
-	 */
-	return minspaces >= rc->rc_nspaces;
+	return rc->rc_longest_nspaces == 0;
 }
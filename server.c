@@ -0,0 +1,719 @@
+#include "server.h"
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>	/* PATH_MAX */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libks/arena-buffer.h"
+#include "libks/arena-vector.h"
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/compiler.h"
+#include "libks/exec.h"
+#include "libks/fs.h"
+#include "libks/vector.h"
+
+#include "arenas.h"
+#include "diff.h"
+#include "format.h"
+#include "options.h"
+#include "style-cache.h"
+#include "util.h"
+
+/* Upper bound of a request or response line. */
+#define SERVER_LINE_MAX		(PATH_MAX + 64)
+/* Number of seconds a client is allowed to stall. */
+#define SERVER_TIMEOUT		10
+
+struct server {
+	const struct server_arg	*arg;
+	int			 lfd;
+	/*
+	 * Unlinked temporary files capturing standard output and error while
+	 * handling a request, along with the original descriptors.
+	 */
+	int			 capture_out;
+	int			 capture_err;
+	int			 stdout_fd;
+	int			 stderr_fd;
+};
+
+struct server_request {
+	enum server_mode	 mode;
+	const char		*path;
+	/* Source code, NULL if it must be read from path. */
+	struct buffer		*src;
+	VECTOR(struct diffchunk) chunks;
+};
+
+struct server_client {
+	const char	*path;
+	FILE		*fp;
+};
+
+static pid_t	server_spawn(struct server *);
+static void	server_worker(struct server *) __attribute__((noreturn));
+static int	server_handle(struct server *, FILE *, int);
+static int	server_exec(struct server *, char *, FILE *, struct buffer **,
+    struct arena_scope *);
+static int	server_listen(const char *);
+static int	server_stale(const struct sockaddr_un *);
+static void	server_kill(void);
+static void	server_sighandler(int);
+
+static int	request_parse(struct server_request *, char *, FILE *,
+    struct arena_scope *);
+static int	request_parse_ranges(struct server_request *, char *,
+    struct arena_scope *);
+
+static void	capture_init(struct server *);
+static void	capture_enter(struct server *);
+static void	capture_leave(struct server *);
+
+static void	server_client_free(void *);
+
+static int	sockaddr_init(struct sockaddr_un *, const char *);
+static int	parse_number(const char *, char **, unsigned long,
+    unsigned long *);
+static int	write_all(int, const char *, size_t);
+
+static const char *modes[] = {
+	[SERVER_PRINT]	= "print",
+	[SERVER_DIFF]	= "diff",
+	[SERVER_CHECK]	= "check",
+};
+
+static volatile sig_atomic_t	 server_done;
+static pid_t			*server_pids;
+static unsigned int		 server_npids;
+
+/*
+ * Serve formatting requests on the given Unix socket until terminated by
+ * SIGINT or SIGTERM. Requests are handled by a pool of worker processes all
+ * forked after initialization, letting each one benefit from the already
+ * initialized tables and parsed styles. Processes are favored over threads
+ * since formatting relies on global state and diffs are produced by diff(1)
+ * writing to standard output.
+ */
+int
+server_run(const struct server_arg *arg)
+{
+	struct server srv = {.arg = arg};
+	struct sigaction sa;
+	unsigned int i, nworkers;
+	int error = 0;
+
+	arena_scope(arg->arena->eternal, s);
+
+	srv.lfd = server_listen(arg->path);
+	if (srv.lfd == -1)
+		return 1;
+
+	nworkers = arg->nworkers;
+	if (nworkers == 0) {
+		long n;
+
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+		nworkers = n > 0 ? (unsigned int)n : 1;
+	}
+	server_pids = arena_calloc(&s, nworkers, sizeof(*server_pids));
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = server_sighandler;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGINT, &sa, NULL) == -1 ||
+	    sigaction(SIGTERM, &sa, NULL) == -1)
+		err(1, "sigaction");
+
+	for (i = 0; i < nworkers && !server_done; i++) {
+		server_pids[i] = server_spawn(&srv);
+		server_npids = i + 1;
+		if (server_pids[i] == -1) {
+			error = 1;
+			server_done = 1;
+		}
+	}
+
+	while (!server_done) {
+		pid_t pid;
+		int status;
+
+		pid = waitpid(-1, &status, 0);
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			warn("waitpid");
+			error = 1;
+			break;
+		}
+		if (WIFSIGNALED(status)) {
+			warnx("worker %d terminated by signal %d",
+			    (int)pid, WTERMSIG(status));
+		}
+
+		/* Replace the worker, unless the server is shutting down. */
+		for (i = 0; i < server_npids; i++) {
+			if (server_pids[i] != pid)
+				continue;
+			server_pids[i] = server_done ? -1 : server_spawn(&srv);
+			break;
+		}
+	}
+
+	server_kill();
+	while (waitpid(-1, NULL, 0) != -1 || errno == EINTR)
+		continue;
+	server_pids = NULL;
+	server_npids = 0;
+	close(srv.lfd);
+	(void)unlink(arg->path);
+	return error;
+}
+
+/*
+ * Handle requests read from standard input until end of input, with the
+ * responses written to standard output. Uses the same protocol as the server
+ * but all requests are handled by the current process, intended for formatting
+ * many buffers without the cost of initialization for each one.
+ */
+int
+server_batch(const struct server_arg *arg)
+{
+	struct server srv = {.arg = arg, .lfd = -1};
+	int error;
+
+	capture_init(&srv);
+	while ((error = server_handle(&srv, stdin, srv.stdout_fd)) == 0)
+		continue;
+	if (error == -1 && ferror(stdin)) {
+		warn("/dev/stdin");
+		error = 1;
+	}
+	close(srv.capture_out);
+	close(srv.capture_err);
+	close(srv.stdout_fd);
+	close(srv.stderr_fd);
+	return error == 1;
+}
+
+/*
+ * Connect to the server listening on the given Unix socket. Returns NULL on
+ * error.
+ */
+struct server_client *
+server_client_alloc(const char *path, struct arena_scope *eternal_scope)
+{
+	struct sockaddr_un sun;
+	struct server_client *sc;
+	int fd;
+
+	if (sockaddr_init(&sun, path))
+		return NULL;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		warn("socket");
+		return NULL;
+	}
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+		warn("%s", path);
+		close(fd);
+		return NULL;
+	}
+
+	sc = arena_calloc(eternal_scope, 1, sizeof(*sc));
+	sc->path = arena_strdup(eternal_scope, path);
+	sc->fp = fdopen(fd, "r");
+	if (sc->fp == NULL)
+		err(1, NULL);
+	arena_cleanup(eternal_scope, server_client_free, sc);
+	return sc;
+}
+
+/*
+ * Let the server format the given source code. The formatted source code or
+ * diff is stored in out and any diagnostics emitted by the server in
+ * diagnostics. Returns the status of the request, or -1 if the server cannot be
+ * reached.
+ */
+int
+server_client_request(struct server_client *sc, enum server_mode mode,
+    const char *path, const struct buffer *src, struct buffer *out,
+    struct buffer *diagnostics)
+{
+	char buf[SERVER_LINE_MAX];
+	char *line = NULL;
+	size_t linesiz = 0;
+	size_t diagnosticslen, outlen;
+	int fd = fileno(sc->fp);
+	int n, status;
+
+	if (strchr(path, '\n') != NULL) {
+		warnx("%s: invalid path", path);
+		return -1;
+	}
+	n = snprintf(buf, sizeof(buf), "%s %zu - %s\n",
+	    modes[mode], buffer_get_len(src), path);
+	if (n < 0 || (size_t)n >= sizeof(buf)) {
+		warnx("%s: path too long", path);
+		return -1;
+	}
+	if (write_all(fd, buf, (size_t)n) ||
+	    write_all(fd, buffer_get_ptr(src), buffer_get_len(src))) {
+		warn("%s", sc->path);
+		return -1;
+	}
+
+	if (getline(&line, &linesiz, sc->fp) == -1 ||
+	    sscanf(line, "%d %zu %zu", &status, &outlen,
+	    &diagnosticslen) != 3) {
+		warnx("%s: malformed response", sc->path);
+		free(line);
+		return -1;
+	}
+	free(line);
+	if (read_buffer(sc->fp, out, outlen) ||
+	    read_buffer(sc->fp, diagnostics, diagnosticslen)) {
+		warnx("%s: short response", sc->path);
+		return -1;
+	}
+	return status;
+}
+
+static pid_t
+server_spawn(struct server *srv)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid == -1) {
+		warn("fork");
+		return -1;
+	}
+	if (pid == 0)
+		server_worker(srv);
+	return pid;
+}
+
+static void
+server_worker(struct server *srv)
+{
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	/* Let writes to disconnected clients fail instead. */
+	signal(SIGPIPE, SIG_IGN);
+
+	capture_init(srv);
+
+	for (;;) {
+		struct timeval tv = {.tv_sec = SERVER_TIMEOUT};
+		FILE *fp;
+		int fd;
+
+		fd = accept(srv->lfd, NULL, NULL);
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			err(1, "accept");
+		}
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv,
+		    sizeof(tv)) == -1 ||
+		    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv,
+		    sizeof(tv)) == -1)
+			warn("setsockopt");
+		fp = fdopen(fd, "r");
+		if (fp == NULL)
+			err(1, NULL);
+		while (server_handle(srv, fp, fd) == 0)
+			continue;
+		fclose(fp);
+	}
+}
+
+/*
+ * Handle a single request read from the client. Returns non-zero if the
+ * connection must be closed, -1 if the client has no more requests.
+ */
+static int
+server_handle(struct server *srv, FILE *fp, int fd)
+{
+	char buf[64];
+	struct buffer *out = NULL;
+	struct buffer *diagnostics;
+	char *line = NULL;
+	size_t linesiz = 0;
+	ssize_t n;
+	int status;
+
+	n = getline(&line, &linesiz, fp);
+	if (n == -1) {
+		free(line);
+		return -1;
+	}
+
+	arena_scope(srv->arg->arena->buffer, s);
+
+	capture_enter(srv);
+	if (n > SERVER_LINE_MAX) {
+		warnx("request too long");
+		status = -1;
+	} else {
+		status = server_exec(srv, line, fp, &out, &s);
+	}
+	capture_leave(srv);
+	free(line);
+
+	if (lseek(srv->capture_err, 0, SEEK_SET) == -1 ||
+	    (diagnostics = arena_buffer_read_fd(&s, srv->capture_err)) == NULL)
+		err(1, "capture");
+	n = snprintf(buf, sizeof(buf), "%d %zu %zu\n",
+	    status == -1 ? 1 : status,
+	    out != NULL ? buffer_get_len(out) : 0,
+	    buffer_get_len(diagnostics));
+	if (write_all(fd, buf, (size_t)n) ||
+	    (out != NULL &&
+	     write_all(fd, buffer_get_ptr(out), buffer_get_len(out))) ||
+	    write_all(fd, buffer_get_ptr(diagnostics),
+	    buffer_get_len(diagnostics)))
+		return 1;
+	return status == -1;
+}
+
+/*
+ * Returns the status of the request, in line with the exit status of knfmt, or
+ * -1 on protocol errors.
+ */
+static int
+server_exec(struct server *srv, char *line, FILE *fp, struct buffer **out,
+    struct arena_scope *s)
+{
+	struct server_request req;
+	struct options *op = srv->arg->options;
+	struct arenas *arena = srv->arg->arena;
+	struct buffer *dst;
+	struct style *st;
+	int error;
+
+	*out = NULL;
+	if (request_parse(&req, line, fp, s))
+		return -1;
+
+	if (req.src == NULL) {
+		req.src = arena_buffer_read(s, req.path);
+		if (req.src == NULL) {
+			warn("%s", req.path);
+			return 1;
+		}
+	}
+	st = style_cache_lookup(srv->arg->styles, req.path);
+	if (st == NULL)
+		return 1;
+
+	dst = arena_buffer_alloc(s, buffer_get_len(req.src) + 1);
+	op->diffparse = req.chunks != NULL;
+	arenas_hint(arena, buffer_get_len(req.src));
+	error = format(&(const struct format_arg){
+	    .path		= req.path,
+	    .src		= req.src,
+	    .dst		= dst,
+	    .diff_chunks	= req.chunks,
+	    .style		= st,
+	    .simple		= srv->arg->simple,
+	    .options		= op,
+	    .arena		= arena,
+	    .typedefs		= srv->arg->typedefs,
+	});
+	arenas_hint(arena, 0);
+	op->diffparse = 0;
+	if (error)
+		return 1;
+
+	switch (req.mode) {
+	case SERVER_PRINT:
+		*out = dst;
+		return 0;
+
+	case SERVER_CHECK:
+		return buffer_cmp(req.src, dst) != 0;
+
+	case SERVER_DIFF:
+		if (buffer_cmp(req.src, dst) == 0)
+			return 0;
+		error = KS_exec_diff(req.path,
+		    buffer_get_ptr(req.src), buffer_get_len(req.src),
+		    buffer_get_ptr(dst), buffer_get_len(dst));
+		if (error == -1) {
+			warn("%s", req.path);
+			return 1;
+		}
+		if (lseek(srv->capture_out, 0, SEEK_SET) == -1 ||
+		    (*out = arena_buffer_read_fd(s, srv->capture_out)) == NULL)
+			err(1, "capture");
+		return error;
+	}
+	return 1;
+}
+
+static int
+server_listen(const char *path)
+{
+	struct sockaddr_un sun;
+	mode_t mask;
+	int error, fd;
+
+	if (sockaddr_init(&sun, path))
+		return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		warn("socket");
+		return -1;
+	}
+	if (server_stale(&sun))
+		(void)unlink(path);
+	/* Only accessible by the current user. */
+	mask = umask(0077);
+	error = bind(fd, (struct sockaddr *)&sun, sizeof(sun));
+	umask(mask);
+	if (error == -1 || listen(fd, SOMAXCONN) == -1) {
+		warn("%s", path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Returns non-zero if the socket is left behind by a server no longer running.
+ */
+static int
+server_stale(const struct sockaddr_un *sun)
+{
+	struct stat sb;
+	int fd, stale;
+
+	if (lstat(sun->sun_path, &sb) == -1 || !S_ISSOCK(sb.st_mode))
+		return 0;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return 0;
+	stale = connect(fd, (const struct sockaddr *)sun, sizeof(*sun)) == -1 &&
+	    errno == ECONNREFUSED;
+	close(fd);
+	return stale;
+}
+
+/*
+ * Terminate all workers, must be async signal safe.
+ */
+static void
+server_kill(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < server_npids; i++) {
+		if (server_pids[i] > 0)
+			(void)kill(server_pids[i], SIGTERM);
+	}
+}
+
+static void
+server_sighandler(int UNUSED(signo))
+{
+	int errno_save = errno;
+
+	server_done = 1;
+	server_kill();
+	errno = errno_save;
+}
+
+/*
+ * Parse request line on the following form, followed by the source code unless
+ * the length is given as "-" in which case the source code is read from path:
+ *
+ *	mode length ranges path
+ */
+static int
+request_parse(struct server_request *req, char *line, FILE *fp,
+    struct arena_scope *s)
+{
+	char *end, *len, *mode, *ranges;
+	unsigned long srclen;
+	size_t i;
+
+	memset(req, 0, sizeof(*req));
+	line[strcspn(line, "\n")] = '\0';
+	mode = strsep(&line, " ");
+	len = strsep(&line, " ");
+	ranges = strsep(&line, " ");
+	if (line == NULL || line[0] == '\0') {
+		warnx("malformed request");
+		return 1;
+	}
+	req->path = line;
+
+	for (i = 0; i < countof(modes); i++) {
+		if (strcmp(mode, modes[i]) == 0)
+			break;
+	}
+	if (i == countof(modes)) {
+		warnx("%s: unknown mode", mode);
+		return 1;
+	}
+	req->mode = (enum server_mode)i;
+
+	if (request_parse_ranges(req, ranges, s))
+		return 1;
+
+	if (strcmp(len, "-") == 0)
+		return 0;
+	if (parse_number(len, &end, ULONG_MAX, &srclen) || *end != '\0') {
+		warnx("%s: invalid length", len);
+		return 1;
+	}
+	req->src = arena_buffer_alloc(s, 1 << 12);
+	if (read_buffer(fp, req->src, srclen)) {
+		warnx("%s: short request", req->path);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Parse ranges of lines on the form beg-end separated by comma, which must be
+ * sorted and disjoint. A single dash denotes all lines.
+ */
+static int
+request_parse_ranges(struct server_request *req, char *ranges,
+    struct arena_scope *s)
+{
+	unsigned int prev = 0;
+
+	if (strcmp(ranges, "-") == 0)
+		return 0;
+
+	ARENA_VECTOR_INIT(s, req->chunks, 1);
+	while (ranges != NULL) {
+		char *end, *range;
+		unsigned long beg, last;
+
+		range = strsep(&ranges, ",");
+		if (parse_number(range, &end, UINT_MAX, &beg) ||
+		    *end++ != '-' ||
+		    parse_number(end, &end, UINT_MAX, &last) ||
+		    *end != '\0' || beg == 0 || beg > last || beg <= prev) {
+			warnx("%s: invalid range", range);
+			return 1;
+		}
+		*ARENA_VECTOR_ALLOC(req->chunks) = (struct diffchunk){
+		    .du_beg	= (unsigned int)beg,
+		    .du_end	= (unsigned int)last,
+		};
+		prev = (unsigned int)last;
+	}
+	return 0;
+}
+
+static void
+capture_init(struct server *srv)
+{
+	char tmppath[PATH_MAX];
+
+	srv->capture_out = KS_fs_tmpfd("", 0, tmppath, sizeof(tmppath));
+	if (srv->capture_out == -1)
+		err(1, "%s", tmppath);
+	srv->capture_err = KS_fs_tmpfd("", 0, tmppath, sizeof(tmppath));
+	if (srv->capture_err == -1)
+		err(1, "%s", tmppath);
+	srv->stdout_fd = dup(1);
+	srv->stderr_fd = dup(2);
+	if (srv->stdout_fd == -1 || srv->stderr_fd == -1)
+		err(1, "dup");
+}
+
+/*
+ * Redirect standard output and error to the capture files, emptied upfront.
+ */
+static void
+capture_enter(struct server *srv)
+{
+	fflush(stdout);
+	fflush(stderr);
+	if (ftruncate(srv->capture_out, 0) == -1 ||
+	    lseek(srv->capture_out, 0, SEEK_SET) == -1 ||
+	    ftruncate(srv->capture_err, 0) == -1 ||
+	    lseek(srv->capture_err, 0, SEEK_SET) == -1)
+		err(1, "capture");
+	if (dup2(srv->capture_out, 1) == -1 || dup2(srv->capture_err, 2) == -1)
+		err(1, "dup2");
+}
+
+static void
+capture_leave(struct server *srv)
+{
+	fflush(stdout);
+	fflush(stderr);
+	if (dup2(srv->stdout_fd, 1) == -1 || dup2(srv->stderr_fd, 2) == -1)
+		err(1, "dup2");
+}
+
+static void
+server_client_free(void *arg)
+{
+	struct server_client *sc = arg;
+
+	fclose(sc->fp);
+}
+
+static int
+sockaddr_init(struct sockaddr_un *sun, const char *path)
+{
+	int n;
+
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	n = snprintf(sun->sun_path, sizeof(sun->sun_path), "%s", path);
+	if (n < 0 || (size_t)n >= sizeof(sun->sun_path)) {
+		warnx("%s: path too long", path);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+parse_number(const char *str, char **end, unsigned long max,
+    unsigned long *res)
+{
+	if (str[0] < '0' || str[0] > '9')
+		return 1;
+	errno = 0;
+	*res = strtoul(str, end, 10);
+	return (*res == ULONG_MAX && errno == ERANGE) || *res > max;
+}
+
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t nw;
+
+		nw = write(fd, buf, len);
+		if (nw == -1)
+			return 1;
+		buf += nw;
+		len -= (size_t)nw;
+	}
+	return 0;
+}
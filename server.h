@@ -0,0 +1,35 @@
+struct arena_scope;
+struct arenas;
+struct buffer;
+struct options;
+struct simple;
+struct style_cache;
+struct typedef_index;
+
+enum server_mode {
+	SERVER_PRINT,
+	SERVER_DIFF,
+	SERVER_CHECK,
+};
+
+struct server_arg {
+	/* Unix socket, unused in batch mode. */
+	const char		*path;
+	struct style_cache	*styles;
+	struct simple		*simple;
+	struct options		*options;
+	struct arenas		*arena;
+	/* Optional typedef names declared in headers. */
+	struct typedef_index	*typedefs;
+	/* Number of worker processes, zero denotes one per processor. */
+	unsigned int		 nworkers;
+};
+
+int	server_run(const struct server_arg *);
+int	server_batch(const struct server_arg *);
+
+struct server_client	*server_client_alloc(const char *,
+    struct arena_scope *);
+int			 server_client_request(struct server_client *,
+    enum server_mode, const char *, const struct buffer *, struct buffer *,
+    struct buffer *);
@@ -96,6 +96,16 @@ is_simple_enabled(const struct simple *si, enum simple_pass pass)
 	    si->passes[pass].state == SIMPLE_STATE_ENABLE;
 }
 
+/*
+ * Returns non-zero if passes not being forced could be entered, i.e. simple
+ * mode is enabled and not temporarily disabled.
+ */
+int
+is_simple_active(const struct simple *si)
+{
+	return si->enable;
+}
+
 int
 simple_disable(struct simple *si)
 {
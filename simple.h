@@ -41,6 +41,7 @@ int	simple_enter(struct simple *, enum simple_pass, unsigned int,
     struct simple_cookie *);
 void	simple_leave(struct simple_cookie *);
 int	is_simple_enabled(const struct simple *, enum simple_pass);
+int	is_simple_active(const struct simple *);
 
 int	simple_disable(struct simple *);
 void	simple_enable(struct simple *, int);
@@ -0,0 +1,403 @@
+#include "style-cache.h"
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>	/* PATH_MAX */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>	/* mkstemp(3) on Linux */
+#include <string.h>
+#include <unistd.h>
+
+#include "libks/arena-buffer.h"
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/map.h"
+#include "libks/vector.h"
+
+#include "options.h"
+#include "style.h"
+#include "trace-types.h"
+#include "trace.h"
+#include "util.h"
+
+/*
+ * Identity of a file system object, used to key both directories and
+ * clang-format configuration files. Fixed width members avoids padding as the
+ * whole key is subject to hashing.
+ */
+struct style_cache_key {
+	uint64_t	dev;
+	uint64_t	ino;
+};
+
+/*
+ * Header of compiled style stored in the cache directory, followed by the
+ * serialized style. The compiled style is only considered valid if the
+ * clang-format configuration file remains the same.
+ */
+struct style_cache_header {
+	uint64_t	mtime;
+	uint64_t	mtime_nsec;
+	uint64_t	size;
+	uint64_t	hash;
+};
+
+struct style_cache {
+	/* Style given on the command line, honored for all files. */
+	struct style		*fixed;
+	/* Style used in absence of a clang-format configuration file. */
+	struct style		*fallback;
+
+	struct {
+		/* Resolved style per directory. */
+		MAP(struct style_cache_key,, struct style *)	dirs;
+		/* Parsed style per clang-format configuration file. */
+		MAP(struct style_cache_key,, struct style *)	files;
+	} cache;
+
+	/* Directory used to store compiled styles, optional. */
+	const char		*dir;
+
+	struct {
+		struct arena_scope	*eternal_scope;
+		struct arena		*scratch;
+	} arena;
+
+	const struct options	*op;
+};
+
+static void	style_cache_free(void *);
+
+static struct style	*style_cache_parse(struct style_cache *, int,
+    const char *);
+static struct style	*style_cache_compiled(struct style_cache *, int,
+    const char *);
+static struct style	*style_cache_load(struct style_cache *, const char *,
+    const struct style_cache_header *);
+static void		 style_cache_store(struct style_cache *, const char *,
+    const struct style_cache_header *, const struct style *);
+
+static int	opendirname(const char *, struct arena *);
+static int	fdkey(int, struct style_cache_key *);
+
+struct style_cache *
+style_cache_alloc(const char *path, const char *dir,
+    struct arena_scope *eternal_scope, struct arena *scratch,
+    const struct options *op)
+{
+	struct style_cache *sc;
+
+	sc = arena_calloc(eternal_scope, 1, sizeof(*sc));
+	arena_cleanup(eternal_scope, style_cache_free, sc);
+	if (MAP_INIT(sc->cache.dirs))
+		err(1, NULL);
+	if (MAP_INIT(sc->cache.files))
+		err(1, NULL);
+	sc->arena.eternal_scope = eternal_scope;
+	sc->arena.scratch = scratch;
+	sc->op = op;
+
+	/*
+	 * Compiled styles are not used while tracing as any diagnostics emitted
+	 * while parsing the clang-format configuration would be lost.
+	 */
+	if (dir != NULL && options_trace_level(op, TRACE_STYLE) == 0) {
+		if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+			warn("%s", dir);
+		else
+			sc->dir = arena_strdup(eternal_scope, dir);
+	}
+
+	if (path != NULL) {
+		int fd;
+
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1) {
+			warn("%s", path);
+			return NULL;
+		}
+		sc->fixed = style_cache_parse(sc, fd, path);
+		close(fd);
+		if (sc->fixed == NULL)
+			return NULL;
+	}
+
+	return sc;
+}
+
+static void
+style_cache_free(void *arg)
+{
+	struct style_cache *sc = arg;
+
+	MAP_FREE(sc->cache.files);
+	MAP_FREE(sc->cache.dirs);
+}
+
+/*
+ * Returns the style applicable to the given file, honoring the nearest
+ * clang-format configuration file found in any directory along the path of the
+ * file. A NULL path denotes standard input in which case the search starts at
+ * the current working directory. All traversed directories are memoized,
+ * making subsequent lookups of files residing in the same directory tree
+ * cheap.
+ */
+struct style *
+style_cache_lookup(struct style_cache *sc, const char *path)
+{
+	VECTOR(struct style_cache_key) visited;
+	struct style *st = NULL;
+	size_t i;
+	int error = 0;
+	int dirfd;
+
+	if (sc->fixed != NULL)
+		return sc->fixed;
+
+	if (VECTOR_INIT(visited))
+		err(1, NULL);
+
+	dirfd = opendirname(path, sc->arena.scratch);
+	while (dirfd != -1) {
+		struct style_cache_key key;
+		const struct style_cache_key *last;
+		struct style_cache_key *dst;
+		struct style **hit;
+		int fd;
+
+		if (fdkey(dirfd, &key) == -1)
+			break;
+		/* The root directory is its own parent. */
+		last = VECTOR_LAST(visited);
+		if (last != NULL && memcmp(last, &key, sizeof(key)) == 0)
+			break;
+
+		hit = MAP_FIND(sc->cache.dirs, key);
+		if (hit != NULL) {
+			st = *hit;
+			break;
+		}
+		dst = VECTOR_ALLOC(visited);
+		if (dst == NULL)
+			err(1, NULL);
+		*dst = key;
+
+		fd = openat(dirfd, ".clang-format", O_RDONLY | O_CLOEXEC);
+		if (fd != -1) {
+			st = style_cache_parse(sc, fd, ".clang-format");
+			close(fd);
+			if (st == NULL)
+				error = 1;
+			break;
+		}
+
+		fd = openat(dirfd, "..", O_RDONLY | O_CLOEXEC | O_DIRECTORY);
+		close(dirfd);
+		dirfd = fd;
+	}
+	if (dirfd != -1)
+		close(dirfd);
+	if (error)
+		goto out;
+
+	if (st == NULL) {
+		if (sc->fallback == NULL) {
+			sc->fallback = style_parse_fd(-1, ".clang-format",
+			    sc->arena.eternal_scope, sc->arena.scratch, sc->op);
+		}
+		st = sc->fallback;
+	}
+
+	for (i = 0; i < VECTOR_LENGTH(visited); i++) {
+		if (MAP_INSERT_VALUE(sc->cache.dirs, visited[i], st) == NULL)
+			err(1, NULL);
+	}
+
+out:
+	VECTOR_FREE(visited);
+	return st;
+}
+
+static struct style *
+style_cache_parse(struct style_cache *sc, int fd, const char *path)
+{
+	struct style_cache_key key;
+	struct style **hit;
+	struct style *st;
+
+	/* The same file could be reached through different directories. */
+	if (fdkey(fd, &key) == -1)
+		return NULL;
+	hit = MAP_FIND(sc->cache.files, key);
+	if (hit != NULL)
+		return *hit;
+
+	if (sc->dir != NULL) {
+		st = style_cache_compiled(sc, fd, path);
+	} else {
+		st = style_parse_fd(fd, path, sc->arena.eternal_scope,
+		    sc->arena.scratch, sc->op);
+	}
+	if (st == NULL)
+		return NULL;
+	if (MAP_INSERT_VALUE(sc->cache.files, key, st) == NULL)
+		err(1, NULL);
+	return st;
+}
+
+/*
+ * Parse the given clang-format configuration file, favoring a previously
+ * compiled style if present in the cache directory. Compiled styles are keyed
+ * by the identity of the configuration file and validated using its
+ * modification time, size and contents.
+ */
+static struct style *
+style_cache_compiled(struct style_cache *sc, int fd, const char *path)
+{
+	struct style_cache_header sh = {0};
+	struct stat sb;
+	struct buffer *bf;
+	struct style *st;
+	const char *name;
+
+	arena_scope(sc->arena.scratch, s);
+
+	if (fstat(fd, &sb) == -1) {
+		warn("%s", path);
+		return NULL;
+	}
+	bf = arena_buffer_read_fd(&s, fd);
+	if (bf == NULL) {
+		warn("%s", path);
+		return NULL;
+	}
+
+	sh.mtime = (uint64_t)sb.st_mtim.tv_sec;
+	sh.mtime_nsec = (uint64_t)sb.st_mtim.tv_nsec;
+	sh.size = (uint64_t)sb.st_size;
+	sh.hash = hash_fnv1a(FNV1A_INIT, buffer_get_ptr(bf),
+	    buffer_get_len(bf));
+
+	name = arena_sprintf(&s, "%s/%016llx%016llx", sc->dir,
+	    (unsigned long long)sb.st_dev, (unsigned long long)sb.st_ino);
+	st = style_cache_load(sc, name, &sh);
+	if (st != NULL)
+		return st;
+
+	st = style_parse_buffer(bf, path, sc->arena.eternal_scope,
+	    sc->arena.scratch, sc->op);
+	if (st != NULL)
+		style_cache_store(sc, name, &sh, st);
+	return st;
+}
+
+static struct style *
+style_cache_load(struct style_cache *sc, const char *name,
+    const struct style_cache_header *want)
+{
+	struct style_cache_header got;
+	struct stat sb;
+	struct style *st = NULL;
+	void *ptr;
+	size_t len;
+	int fd;
+
+	fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+	if (fstat(fd, &sb) == -1 || (size_t)sb.st_size < sizeof(got)) {
+		close(fd);
+		return NULL;
+	}
+	len = (size_t)sb.st_size;
+	ptr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	memcpy(&got, ptr, sizeof(got));
+	if (memcmp(&got, want, sizeof(got)) == 0) {
+		st = style_deserialize((const char *)ptr + sizeof(got),
+		    len - sizeof(got), sc->arena.eternal_scope,
+		    sc->arena.scratch, sc->op);
+	}
+	munmap(ptr, len);
+	return st;
+}
+
+/*
+ * Store the given compiled style. Failures are not considered fatal as the
+ * style can always be parsed from scratch.
+ */
+static void
+style_cache_store(struct style_cache *sc, const char *name,
+    const struct style_cache_header *sh, const struct style *st)
+{
+	char tmppath[PATH_MAX];
+	struct buffer *bf;
+	const char *buf;
+	size_t buflen;
+	int fd, n;
+
+	arena_scope(sc->arena.scratch, s);
+
+	n = snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", name);
+	if (n < 0 || (size_t)n >= sizeof(tmppath))
+		return;
+	fd = mkstemp(tmppath);
+	if (fd == -1)
+		return;
+
+	bf = arena_buffer_alloc(&s, 1 << 10);
+	buffer_puts(bf, (const char *)sh, sizeof(*sh));
+	style_serialize(st, bf);
+	buf = buffer_get_ptr(bf);
+	buflen = buffer_get_len(bf);
+	while (buflen > 0) {
+		ssize_t nw;
+
+		nw = write(fd, buf, buflen);
+		if (nw == -1)
+			break;
+		buf += nw;
+		buflen -= (size_t)nw;
+	}
+	close(fd);
+	if (buflen > 0 || rename(tmppath, name) == -1)
+		(void)unlink(tmppath);
+}
+
+static int
+opendirname(const char *path, struct arena *scratch)
+{
+	const char *dir = ".";
+	const char *p;
+
+	arena_scope(scratch, s);
+
+	if (path != NULL && (p = strrchr(path, '/')) != NULL) {
+		dir = p == path ? "/" :
+		    arena_strndup(&s, path, (size_t)(p - path));
+	}
+	return open(dir, O_RDONLY | O_CLOEXEC | O_DIRECTORY);
+}
+
+static int
+fdkey(int fd, struct style_cache_key *key)
+{
+	struct stat sb;
+
+	if (fstat(fd, &sb) == -1)
+		return -1;
+	key->dev = (uint64_t)sb.st_dev;
+	key->ino = (uint64_t)sb.st_ino;
+	return 0;
+}
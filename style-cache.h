@@ -0,0 +1,9 @@
+struct arena;
+struct arena_scope;
+struct options;
+struct style;
+
+struct style_cache	*style_cache_alloc(const char *, const char *,
+    struct arena_scope *, struct arena *, const struct options *);
+struct style		*style_cache_lookup(struct style_cache *,
+    const char *);
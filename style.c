@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include "libks/arena-buffer.h"
@@ -19,6 +20,7 @@
 #include "libks/arithmetic.h"
 #include "libks/buffer.h"
 #include "libks/compiler.h"
+#include "libks/map.h"
 #include "libks/string.h"
 #include "libks/vector.h"
 
@@ -28,6 +30,7 @@
 #include "token.h"
 #include "trace-types.h"
 #include "trace.h"
+#include "util.h"
 
 #define style_trace(st, fmt, ...) \
 	trace_no_func(TRACE_STYLE, (st)->op, (fmt), __VA_ARGS__)
@@ -77,12 +80,32 @@ struct style {
 	VECTOR(struct include_category)	 include_categories;
 	VECTOR(struct include_guard)	 include_guards;
 
+	/*
+	 * Include categories indexed by the first character of the include
+	 * path, see style_include_categories_compile().
+	 */
+	struct {
+		uint32_t	*candidates;
+		uint32_t	 offsets[UCHAR_MAX + 2];
+	} include_index;
+	/* Memoized include priorities keyed by include path. */
+	struct {
+		MAP(const char, *, struct include_priority)	priorities;
+	} include_memo;
+
 	struct regex			*regex;
 };
 
 struct regex {
 	const char	*pattern;
 	regex_t		 r;
+	/*
+	 * Lower case literal prefix of anchored patterns. If exhaustive, the
+	 * pattern is nothing but the prefix.
+	 */
+	const char	*prefix;
+	size_t		 prefixlen;
+	int		 exhaustive;
 };
 
 struct include_category {
@@ -95,6 +118,24 @@ struct include_guard {
 	unsigned int	ncomponents;
 };
 
+/* Serialized style, see style_serialize(). */
+#define STYLE_MAGIC	0x4c595453544d464bULL	/* "KNFMTSTY" */
+
+struct style_header {
+	uint64_t	magic;
+	uint64_t	schema;
+	uint32_t	noptions;
+	uint32_t	ncategories;
+	uint32_t	nguards;
+	uint32_t	unused;
+};
+
+/* Serialized include category or guard, followed by the regex pattern. */
+struct style_record {
+	int32_t		val[2];
+	uint32_t	len;
+};
+
 struct style_option {
 	int		 so_scope;
 	const char	*so_key;
@@ -123,6 +164,18 @@ static void	style_dump(const struct style *);
 static void	style_dump_IncludeCategories(const struct style *);
 static void	style_dump_IncludeGuards(const struct style *);
 
+static struct style	*style_alloc(struct arena_scope *, struct arena *,
+    const struct options *);
+static uint64_t		 style_schema(void);
+static int		 style_read(const char **, size_t *, void *, size_t);
+
+static void	style_include_categories_compile(struct style *);
+
+static int	regex_compile(struct regex *, char *, size_t);
+static void	regex_prefix(struct regex *, struct arena_scope *);
+static int	regex_prefix_match(const struct regex *, const char *);
+static int	regex_prefix_match_char(const struct regex *, unsigned int);
+
 static struct token			*yaml_read(struct lexer *, void *);
 static struct token			*yaml_read_integer(struct lexer *);
 static struct token			*yaml_token_alloc(struct arena_scope *,
@@ -404,6 +457,33 @@ style_parse(const char *path, struct arena_scope *eternal_scope,
 	return st;
 }
 
+/*
+ * Parse the clang-format configuration file referred to by the given file
+ * descriptor. A file descriptor equal to -1 denotes absence of a configuration
+ * file, causing the default style to be used.
+ */
+struct style *
+style_parse_fd(int fd, const char *path, struct arena_scope *eternal_scope,
+    struct arena *scratch, const struct options *op)
+{
+	struct buffer *bf = NULL;
+	struct style *st;
+
+	arena_scope(scratch, s);
+
+	if (fd != -1) {
+		bf = arena_buffer_read_fd(&s, fd);
+		if (bf == NULL) {
+			warn("%s", path);
+			return NULL;
+		}
+	}
+	st = style_parse_buffer(bf, path, eternal_scope, scratch, op);
+	if (st != NULL && options_trace_level(op, TRACE_STYLE) >= 2)
+		style_dump(st);
+	return st;
+}
+
 struct style *
 style_parse_buffer(const struct buffer *bf, const char *path,
     struct arena_scope *eternal_scope, struct arena *scratch,
@@ -411,15 +491,7 @@ style_parse_buffer(const struct buffer *bf, const char *path,
 {
 	struct style *st;
 
-	st = arena_calloc(eternal_scope, 1, sizeof(*st));
-	arena_cleanup(eternal_scope, style_free, st);
-	st->arena.eternal_scope = eternal_scope;
-	st->arena.scratch = scratch;
-	st->op = op;
-	if (VECTOR_INIT(st->include_categories))
-		err(1, NULL);
-	if (VECTOR_INIT(st->include_guards))
-		err(1, NULL);
+	st = style_alloc(eternal_scope, scratch, op);
 	style_defaults(st);
 	if (bf == NULL) {
 		 /*
@@ -431,6 +503,128 @@ style_parse_buffer(const struct buffer *bf, const char *path,
 		/* Errors are not considered fatal. */
 		(void)style_parse_yaml(st, path, bf);
 	}
+	style_include_categories_compile(st);
+	return st;
+}
+
+/*
+ * Serialize the given style into a compact binary representation, suitable to
+ * be read back using style_deserialize().
+ */
+void
+style_serialize(const struct style *st, struct buffer *bf)
+{
+	struct style_header sh = {
+		.magic		= STYLE_MAGIC,
+		.schema		= style_schema(),
+		.noptions	= Last,
+	};
+	size_t i;
+
+	sh.ncategories = (uint32_t)VECTOR_LENGTH(st->include_categories);
+	sh.nguards = (uint32_t)VECTOR_LENGTH(st->include_guards);
+	buffer_puts(bf, (const char *)&sh, sizeof(sh));
+	buffer_puts(bf, (const char *)st->options, sizeof(st->options));
+	for (i = 0; i < VECTOR_LENGTH(st->include_categories); i++) {
+		const struct include_category *ic = &st->include_categories[i];
+		struct style_record sr = {
+			.val	= { ic->priority.group, ic->priority.sort },
+			.len	= (uint32_t)strlen(ic->regex.pattern),
+		};
+
+		buffer_puts(bf, (const char *)&sr, sizeof(sr));
+		buffer_puts(bf, ic->regex.pattern, sr.len);
+	}
+	for (i = 0; i < VECTOR_LENGTH(st->include_guards); i++) {
+		const struct include_guard *guard = &st->include_guards[i];
+		struct style_record sr = {
+			.val	= { (int32_t)guard->ncomponents, 0 },
+			.len	= (uint32_t)strlen(guard->regex.pattern),
+		};
+
+		buffer_puts(bf, (const char *)&sr, sizeof(sr));
+		buffer_puts(bf, guard->regex.pattern, sr.len);
+	}
+}
+
+/*
+ * Construct a style from the representation emitted by style_serialize().
+ * Returns NULL if the representation is malformed or stems from an
+ * incompatible version of knfmt.
+ */
+struct style *
+style_deserialize(const char *buf, size_t buflen,
+    struct arena_scope *eternal_scope, struct arena *scratch,
+    const struct options *op)
+{
+	struct style_header sh;
+	struct style *st;
+	uint32_t i;
+
+	if (!style_read(&buf, &buflen, &sh, sizeof(sh)))
+		return NULL;
+	if (sh.magic != STYLE_MAGIC || sh.schema != style_schema() ||
+	    sh.noptions != Last)
+		return NULL;
+
+	st = style_alloc(eternal_scope, scratch, op);
+	if (!style_read(&buf, &buflen, st->options, sizeof(st->options)))
+		return NULL;
+	for (i = 0; i < sh.ncategories + sh.nguards; i++) {
+		char errbuf[128];
+		struct style_record sr;
+		struct regex *regex;
+
+		if (!style_read(&buf, &buflen, &sr, sizeof(sr)) ||
+		    sr.len > buflen)
+			return NULL;
+		if (i < sh.ncategories) {
+			struct include_category *ic;
+
+			ic = VECTOR_CALLOC(st->include_categories);
+			if (ic == NULL)
+				err(1, NULL);
+			ic->priority.group = sr.val[0];
+			ic->priority.sort = sr.val[1];
+			regex = &ic->regex;
+		} else {
+			struct include_guard *guard;
+
+			guard = VECTOR_CALLOC(st->include_guards);
+			if (guard == NULL)
+				err(1, NULL);
+			guard->ncomponents = (unsigned int)sr.val[0];
+			regex = &guard->regex;
+		}
+		regex->pattern = arena_strndup(eternal_scope, buf, sr.len);
+		buf += sr.len;
+		buflen -= sr.len;
+		if (regex_compile(regex, errbuf, sizeof(errbuf)))
+			return NULL;
+	}
+	if (buflen > 0)
+		return NULL;
+	style_include_categories_compile(st);
+	return st;
+}
+
+static struct style *
+style_alloc(struct arena_scope *eternal_scope, struct arena *scratch,
+    const struct options *op)
+{
+	struct style *st;
+
+	st = arena_calloc(eternal_scope, 1, sizeof(*st));
+	arena_cleanup(eternal_scope, style_free, st);
+	st->arena.eternal_scope = eternal_scope;
+	st->arena.scratch = scratch;
+	st->op = op;
+	if (VECTOR_INIT(st->include_categories))
+		err(1, NULL);
+	if (VECTOR_INIT(st->include_guards))
+		err(1, NULL);
+	if (MAP_INIT(st->include_memo.priorities))
+		err(1, NULL);
 	return st;
 }
 
@@ -454,6 +648,8 @@ style_free(void *arg)
 		regfree(&guard->regex.r);
 	}
 	VECTOR_FREE(st->include_guards);
+
+	MAP_FREE(st->include_memo.priorities);
 }
 
 unsigned int
@@ -542,19 +738,36 @@ style_include_priorities(const struct style *st)
 struct include_priority
 style_include_priority(const struct style *st, const char *include_path)
 {
-	size_t i, n;
-
-	n = VECTOR_LENGTH(st->include_categories);
-	for (i = 0; i < n; i++) {
-		const struct include_category *ic = &st->include_categories[i];
-		int error;
-
-		error = regexec(&ic->regex.r, include_path, 0, NULL, 0);
-		if (error == 0)
-			return ic->priority;
+	struct include_priority priority = {.group = INT_MAX, .sort = INT_MAX};
+	const struct include_priority *memo;
+	uint32_t beg, end, i;
+	unsigned char c;
+
+	memo = MAP_FIND(st->include_memo.priorities, include_path);
+	if (memo != NULL)
+		return *memo;
+
+	/* Only consider categories applicable to the first character. */
+	c = (unsigned char)include_path[0];
+	beg = st->include_index.offsets[c];
+	end = st->include_index.offsets[c + 1];
+	for (i = beg; i < end; i++) {
+		const struct include_category *ic =
+		    &st->include_categories[st->include_index.candidates[i]];
+
+		if (!regex_prefix_match(&ic->regex, include_path))
+			continue;
+		if (ic->regex.exhaustive ||
+		    regexec(&ic->regex.r, include_path, 0, NULL, 0) == 0) {
+			priority = ic->priority;
+			break;
+		}
 	}
 
-	return (struct include_priority){.group = INT_MAX, .sort = INT_MAX};
+	if (MAP_INSERT_VALUE(st->include_memo.priorities, include_path,
+	    priority) == NULL)
+		err(1, NULL);
+	return priority;
 }
 
 static void
@@ -1396,6 +1609,7 @@ parse_Priority(struct style *st, struct lexer *lx,
 static int
 parse_Regex(struct style *st, struct lexer *lx, const struct style_option *so)
 {
+	char errbuf[128];
 	struct regex *regex;
 	struct token *tk;
 	int error;
@@ -1411,23 +1625,168 @@ parse_Regex(struct style *st, struct lexer *lx, const struct style_option *so)
 	    tk->tk_str, tk->tk_len);
 	/* Allow the pattern to be redefined. */
 	regfree(&regex->r);
+	if (regex_compile(regex, errbuf, sizeof(errbuf))) {
+		lexer_error(lx, tk, __func__, __LINE__, "%s", errbuf);
+		return FAIL;
+	}
+	return GOOD;
+}
+
+/*
+ * Construct an index of include categories keyed by the first character of the
+ * include path. Categories lacking a literal prefix are applicable to all
+ * characters. The order of categories is preserved as the first matching one
+ * wins.
+ */
+static void
+style_include_categories_compile(struct style *st)
+{
+	uint32_t count[UCHAR_MAX + 1] = {0};
+	uint32_t i, n, total;
+	uint32_t *offsets = st->include_index.offsets;
+	unsigned int c;
+
+	n = (uint32_t)VECTOR_LENGTH(st->include_categories);
+	for (i = 0; i < n; i++) {
+		struct include_category *ic = &st->include_categories[i];
+
+		regex_prefix(&ic->regex, st->arena.eternal_scope);
+		for (c = 0; c <= UCHAR_MAX; c++) {
+			if (regex_prefix_match_char(&ic->regex, c))
+				count[c]++;
+		}
+	}
+
+	total = 0;
+	for (c = 0; c <= UCHAR_MAX; c++) {
+		offsets[c] = total;
+		total += count[c];
+	}
+	offsets[UCHAR_MAX + 1] = total;
+	if (total == 0)
+		return;
+
+	st->include_index.candidates = arena_calloc(st->arena.eternal_scope,
+	    total, sizeof(*st->include_index.candidates));
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < n; i++) {
+		const struct include_category *ic = &st->include_categories[i];
+
+		for (c = 0; c <= UCHAR_MAX; c++) {
+			if (regex_prefix_match_char(&ic->regex, c)) {
+				st->include_index.candidates[
+				    offsets[c] + count[c]++] = i;
+			}
+		}
+	}
+}
+
+static int
+regex_compile(struct regex *regex, char *errbuf, size_t errsiz)
+{
+	int error;
+
 	error = regcomp(&regex->r, regex->pattern,
 	    REG_EXTENDED | REG_NOSUB | REG_ICASE);
-	if (error) {
-		char errbuf[128] = {0};
+	if (error == 0)
+		return 0;
 
-		if (error == REG_EPAREN) {
-			/* Use platform agnostic error for testing. */
-			(void)snprintf(errbuf, sizeof(errbuf),
-			    "parentheses not balanced");
-		} else {
-			regerror(error, &regex->r,
-			    errbuf, sizeof(errbuf));
+	memset(errbuf, 0, errsiz);
+	if (error == REG_EPAREN) {
+		/* Use platform agnostic error for testing. */
+		(void)snprintf(errbuf, errsiz, "parentheses not balanced");
+	} else {
+		regerror(error, &regex->r, errbuf, errsiz);
+	}
+	return 1;
+}
+
+/*
+ * Extract the literal prefix of an anchored extended regular expression,
+ * allowing the regex to be skipped for strings lacking the same prefix.
+ * Alternations are not recognized, causing no prefix to be extracted.
+ */
+static void
+regex_prefix(struct regex *regex, struct arena_scope *s)
+{
+	struct buffer *bf;
+	const char *p = regex->pattern;
+
+	regex->prefix = NULL;
+	regex->prefixlen = 0;
+	regex->exhaustive = 0;
+	if (p[0] != '^' || strchr(p, '|') != NULL)
+		return;
+
+	bf = arena_buffer_alloc(s, 64);
+	for (p++; *p != '\0'; p++) {
+		char c = *p;
+
+		if (c == '\\') {
+			if (!ispunct((unsigned char)p[1]))
+				break;
+			c = *++p;
+		} else if (strchr(".[]()*+?{}^$", c) != NULL) {
+			break;
 		}
-		lexer_error(lx, tk, __func__, __LINE__, "%s", errbuf);
-		return FAIL;
+		/* Character subject to repetition is optional. */
+		if (p[1] == '*' || p[1] == '?' || p[1] == '{') {
+			p++;
+			break;
+		}
+		buffer_putc(bf, (char)tolower((unsigned char)c));
 	}
-	return GOOD;
+	regex->prefixlen = buffer_get_len(bf);
+	regex->prefix = buffer_str(bf);
+	regex->exhaustive = *p == '\0';
+}
+
+static int
+regex_prefix_match(const struct regex *regex, const char *str)
+{
+	return regex->prefixlen == 0 ||
+	    strncasecmp(str, regex->prefix, regex->prefixlen) == 0;
+}
+
+static int
+regex_prefix_match_char(const struct regex *regex, unsigned int c)
+{
+	return regex->prefixlen == 0 ||
+	    (unsigned int)tolower((int)c) ==
+	    (unsigned char)regex->prefix[0];
+}
+
+static int
+style_read(const char **buf, size_t *buflen, void *dst, size_t len)
+{
+	if (*buflen < len)
+		return 0;
+	memcpy(dst, *buf, len);
+	*buf += len;
+	*buflen -= len;
+	return 1;
+}
+
+/*
+ * Fingerprint of all style keywords as the serialized style is only compatible
+ * with the exact same set of keywords.
+ */
+static uint64_t
+style_schema(void)
+{
+	static uint64_t schema = 0;
+	int i;
+
+	if (schema != 0)
+		return schema;
+
+	schema = FNV1A_INIT;
+	for (i = First; i < Last; i++) {
+		const char *str = style_keyword_str((enum style_keyword)i);
+
+		schema = hash_fnv1a(schema, str, strlen(str));
+	}
+	return schema;
 }
 
 static const char *
@@ -1,3 +1,5 @@
+#include <stddef.h>	/* size_t */
+
 struct arena;
 struct arena_scope;
 struct buffer;
@@ -121,8 +123,13 @@ void	style_dump_keywords(struct buffer *);
 
 struct style	*style_parse(const char *, struct arena_scope *,
     struct arena *, const struct options *);
+struct style	*style_parse_fd(int, const char *, struct arena_scope *,
+    struct arena *, const struct options *);
 struct style	*style_parse_buffer(const struct buffer *, const char *,
     struct arena_scope *, struct arena *, const struct options *);
+struct style	*style_deserialize(const char *, size_t, struct arena_scope *,
+    struct arena *, const struct options *);
+void		 style_serialize(const struct style *, struct buffer *);
 
 unsigned int	style(const struct style *, int);
 int		style_brace_wrapping(const struct style *, int);
@@ -1,5 +1,7 @@
 #include "config.h"
 
+#include <err.h>
+#include <limits.h>	/* UINT_MAX */
 #include <string.h>
 
 #include "libks/arena-buffer.h"
@@ -8,12 +10,15 @@
 #include "libks/compiler.h"
 #include "libks/expect.h"
 #include "libks/list.h"
+#include "libks/vector.h"
 
 #include "arenas.h"
 #include "clang.h"
+#include "diff.h"
 #include "doc.h"
 #include "expr.h"
 #include "lexer.h"
+#include "libknfmt.h"
 #include "options.h"
 #include "parser-attributes.h"
 #include "parser-expr.h"
@@ -89,10 +94,24 @@ static void	test_strwidth_impl(const char *, size_t, size_t, int);
 static void	test_path_slice_impl(struct context *, const char *,
     unsigned int, const char *, int);
 
+#define test_diff_get_chunk_range(a, b, c) \
+	test_diff_get_chunk_range_impl((a), (b), (c), __LINE__)
+static void	test_diff_get_chunk_range_impl(unsigned int, unsigned int,
+    unsigned int, int);
+
 #define test_token_branch_unlink() \
 	test_token_branch_impl(&ctx)
 static void	test_token_branch_impl(struct context *);
 
+#define test_libknfmt(a, b) \
+	test_libknfmt_impl(kf, (a), (b), 0, 0, __LINE__)
+#define test_libknfmt_range(a, b, c, d) \
+	test_libknfmt_impl(kf, (c), (d), (a), (b), __LINE__)
+#define test_libknfmt_range_invalid(a, b) \
+	test_libknfmt_impl(kf, "int a;\n", NULL, (a), (b), __LINE__)
+static void	test_libknfmt_impl(struct knfmt *, const char *, const char *,
+    unsigned int, unsigned int, int);
+
 static void	test_token_serialize(struct context *);
 static void	test_clang_token_serialize(struct context *);
 
@@ -118,6 +137,7 @@ int
 main(void)
 {
 	struct context ctx = {0};
+	struct knfmt *kf;
 
 	clang_init();
 	expr_init();
@@ -374,6 +394,15 @@ main(void)
 	test_strwidth("int\nx", 0, 1);
 	test_strwidth("int\n", 0, 0);
 
+	test_diff_get_chunk_range(1, 1, 0);
+	test_diff_get_chunk_range(1, 2, 2);
+	test_diff_get_chunk_range(3, 3, 2);
+	test_diff_get_chunk_range(4, 4, 0);
+	test_diff_get_chunk_range(4, 9, 5);
+	test_diff_get_chunk_range(6, 7, 0);
+	test_diff_get_chunk_range(10, 20, 8);
+	test_diff_get_chunk_range(11, 20, 0);
+
 	test_path_slice("", 1, "");
 	test_path_slice("", 2, "");
 	test_path_slice("file", 1, "file");
@@ -390,6 +419,26 @@ main(void)
 	style_shutdown();
 	expr_shutdown();
 	clang_shutdown();
+
+	/* Must be exercised last as it manages the global state itself. */
+	kf = knfmt_alloc(NULL, 0);
+	if (kf == NULL)
+		errx(1, "knfmt_alloc");
+	test_libknfmt("int a=1;\n", "int a = 1;\n");
+	test_libknfmt("int a = 1;\n", "int a = 1;\n");
+	test_libknfmt_range(2, 2, "int a=1;\nint b=2;\n",
+	    "int a=1;\nint b = 2;\n");
+	test_libknfmt_range_invalid(0, 1);
+	test_libknfmt_range_invalid(2, 1);
+	test_libknfmt_range_invalid(1, UINT_MAX);
+	knfmt_free(kf);
+	kf = knfmt_alloc(NULL, KNFMT_SIMPLE);
+	if (kf == NULL)
+		errx(1, "knfmt_alloc");
+	test_libknfmt("int\nmain(void)\n{\n\treturn (0);\n}\n",
+	    "int\nmain(void)\n{\n\treturn 0;\n}\n");
+	knfmt_free(kf);
+
 	return 0;
 }
 
@@ -584,6 +633,55 @@ test_strwidth_impl(const char *str, size_t pos, size_t exp, int lno)
 	KS_expect_int(exp, act);
 }
 
+static void
+test_libknfmt_impl(struct knfmt *kf, const char *src, const char *exp,
+    unsigned int beg, unsigned int end, int lno)
+{
+	const struct knfmt_range range = { beg, end };
+	const char *act;
+	size_t actlen = 0;
+
+	KS_expect_scope("libknfmt", lno, e);
+
+	act = knfmt_format(kf, "t.c", src, strlen(src), &range,
+	    beg > 0 || end > 0 ? 1 : 0, &actlen);
+	if (exp == NULL) {
+		KS_expect_true(act == NULL);
+		return;
+	}
+	KS_expect_true(act != NULL);
+	KS_expect_str_n(exp, act, actlen);
+}
+
+static void
+test_diff_get_chunk_range_impl(unsigned int beg, unsigned int end,
+    unsigned int exp, int lno)
+{
+	static const struct diffchunk src[] = {
+		{ 2, 3 }, { 5, 5 }, { 8, 10 },
+	};
+	VECTOR(struct diffchunk) chunks;
+	const struct diffchunk *du;
+	size_t i;
+
+	KS_expect_scope("diff_get_chunk_range", lno, e);
+
+	if (VECTOR_INIT(chunks))
+		err(1, NULL);
+	for (i = 0; i < countof(src); i++) {
+		struct diffchunk *dst;
+
+		dst = VECTOR_ALLOC(chunks);
+		if (dst == NULL)
+			err(1, NULL);
+		*dst = src[i];
+	}
+
+	du = diff_get_chunk_range(chunks, beg, end);
+	KS_expect_int(exp, du != NULL ? du->du_beg : 0);
+	VECTOR_FREE(chunks);
+}
+
 static void
 test_path_slice_impl(struct context *ctx, const char *path,
     unsigned int ncomponents, const char *exp, int lno)
@@ -0,0 +1,48 @@
+# Ensure records read from standard input are formatted in batch mode.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+# record mode ranges path source
+record() {
+	printf '%s %d %s %s\n%s' "$1" "${#4}" "$2" "$3" "$4"
+}
+
+# Preserve trailing new lines.
+_a="$(printf 'int a=1;\nint b=2;\n_')"; _a="${_a%_}"
+_b="$(printf 'int c = 3;\n_')"; _b="${_b%_}"
+_c="$(printf 'int d = {\n_')"; _c="${_c%_}"
+
+{
+	record print - a.c "${_a}"
+	record print 2-2 a.c "${_a}"
+	record check - b.c "${_b}"
+	record check - a.c "${_a}"
+	record print - c.c "${_c}"
+	record print - b.c "${_b}"
+} | ${EXEC:-} "${KNFMT}" -b >out
+diff -u - out <<EOF1
+0 22 0
+int a = 1;
+int b = 2;
+0 20 0
+int a=1;
+int b = 2;
+0 0 0
+1 0 0
+1 0 46
+c.c:1: error at INT<1:1>("int")
+int d = {
+^^^
+0 11 0
+int c = 3;
+EOF1
+
+# Malformed records terminate the batch.
+! printf 'print 1\n' | ${EXEC:-} "${KNFMT}" -b >out
+grep -q '^1 0 ' out
@@ -0,0 +1,37 @@
+# Ensure a declaration exceeding the work budget is emitted verbatim while
+# surrounding declarations are still formatted.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+_x="$(seq -s , 1 100)"
+printf 'int a=1;\n\nint x[] = {%s};\n\nint b=2;\n' "${_x}" >a.c
+
+${EXEC:-} "${KNFMT}" -B 1000 a.c >out 2>err
+diff -u - out <<EOF1
+int a = 1;
+
+int x[] = {${_x}};
+
+int b = 2;
+EOF1
+grep -q 'a.c:3: work budget exhausted' err
+
+# A budget of zero denotes no limit.
+${EXEC:-} "${KNFMT}" -B 0 a.c >out 2>err
+[ -s err ] && exit 1
+grep -q '^int x\[\] = {1, 2, 3, ' out
+
+# The layout of a call with thousands of arguments exceeds the default budget.
+_x="$(seq -s ', ' -f 'x%g' 1 5000)"
+printf 'int\nmain(void)\n{\n\treturn f(%s);\n}\n' "${_x}" >b.c
+${EXEC:-} "${KNFMT}" b.c >out 2>err
+cmp -s b.c out
+grep -q 'b.c:1: work budget exhausted' err
+
+! ${EXEC:-} "${KNFMT}" -B x a.c 2>/dev/null
@@ -0,0 +1,37 @@
+# Ensure all files in a diff are formatted, including chunk headers carrying
+# function context.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+printf 'int\nx;\n\nstatic int\ny;\n' >a.c
+printf 'int\nz;\n' >b.c
+cat <<'EOF1' >patch
+diff --git a/a.c b/a.c
+--- a/a.c
++++ b/a.c
+@@ -3,3 +3,3 @@ int x = 1 + 2;
+ 
+-int
++static int
+ y;
+--- b.c.orig	2024-01-01 00:00:00
++++ b.c	2024-01-01 00:00:00
+@@ -0,0 +1,2 @@
++int
++z;
+EOF1
+
+${EXEC:-} "${KNFMT}" -D <patch >out
+diff -u - out <<'EOF1'
+int
+x;
+
+static int y;
+int z;
+EOF1
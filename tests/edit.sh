@@ -0,0 +1,33 @@
+# Ensure edits are confined to the changed bytes.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+printf 'int a=1;\n' >a.c
+printf 'int b = 2;\n' >b.c
+printf 'int\nmain(void) {\n\treturn 0;\n}\n' >c.c
+
+! ${EXEC:-} "${KNFMT}" -E a.c b.c >out
+diff -u - out <<EOF1
+{"path":"a.c","edits":[{"offset":5,"length":0,"replacement":" "},{"offset":6,"length":0,"replacement":" "}]}
+EOF1
+
+! ${EXEC:-} "${KNFMT}" -E c.c >out
+diff -u - out <<EOF1
+{"path":"c.c","edits":[{"offset":14,"length":1,"replacement":"\n"}]}
+EOF1
+
+# Tokens removed in simple mode.
+printf 'int\nmain(void)\n{\n\tif (a) {\n\t\treturn 0;\n\t}\n}\n' >d.c
+! ${EXEC:-} "${KNFMT}" -Es d.c >out
+diff -u - out <<EOF1
+{"path":"d.c","edits":[{"offset":24,"length":2,"replacement":""},{"offset":39,"length":1,"replacement":""},{"offset":42,"length":2,"replacement":""}]}
+EOF1
+
+${EXEC:-} "${KNFMT}" -E b.c >out
+! [ -s out ]
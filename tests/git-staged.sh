@@ -0,0 +1,59 @@
+# Ensure only staged changes are formatted, read from the Git index.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+command -v git >/dev/null 2>&1 || exit 0
+
+export GIT_CONFIG_GLOBAL=/dev/null GIT_CONFIG_NOSYSTEM=1
+git init -q .
+git config user.name knfmt
+git config user.email knfmt@localhost
+
+mkdir src
+printf 'int a=1;\n' >src/a.c
+printf 'int b=1;\n' >b.c
+git add src/a.c b.c
+git commit -q -m initial
+
+# Staged change.
+printf 'int a=1;\nint c=2;\n' >src/a.c
+git add src/a.c
+# Unstaged changes, must be left untouched.
+printf 'int a=1;\nint c=2;\nint d=3;\n' >src/a.c
+printf 'int b=2;\n' >b.c
+
+! ${EXEC:-} "${KNFMT}" -Gd >out
+diff -u - out <<'EOF1'
+--- src/a.c.orig
++++ src/a.c
+@@ -1,2 +1,2 @@
+ int a=1;
+-int c=2;
++int c = 2;
+EOF1
+
+# Paths relative to the current directory.
+(cd src && ${EXEC:-} "${KNFMT}" -G) >out
+diff -u - out <<'EOF1'
+int a=1;
+int c = 2;
+EOF1
+
+# Limited to the given paths.
+${EXEC:-} "${KNFMT}" -Gd b.c >out
+! [ -s out ]
+
+# Paths containing spaces.
+git commit -q -m staged
+printf 'int e=1;\n' >'src/my file.c'
+git add 'src/my file.c'
+${EXEC:-} "${KNFMT}" -G 'src/my file.c' >out
+echo 'int e = 1;' | diff -u - out
+(cd src && ${EXEC:-} "${KNFMT}" -G) >out
+echo 'int e = 1;' | diff -u - out
@@ -0,0 +1,34 @@
+# Ensure in place edits retain permissions and leave no temporary files behind.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+for _sync in none file batch; do
+	printf 'int a=1;\n' >a.c
+	chmod 640 a.c
+	${EXEC:-} "${KNFMT}" -i -F "${_sync}" a.c
+	echo 'int a = 1;' | diff -u - a.c
+	# shellcheck disable=SC2012
+	ls -l a.c | grep -q '^-rw-r-----'
+	[ "$(ls -A)" = "a.c" ]
+done
+
+# More files than fit in a single batch.
+mkdir many
+_i=0
+while [ "${_i}" -lt 100 ]; do
+	printf 'int a=1;\n' >"many/${_i}.c"
+	_i=$((_i + 1))
+done
+${EXEC:-} "${KNFMT}" -i -F batch many/*.c
+cat many/*.c | sort -u >out
+echo 'int a = 1;' | diff -u - out
+rm -r many out
+
+! ${EXEC:-} "${KNFMT}" -i -F nein a.c 2>/dev/null
+! ${EXEC:-} "${KNFMT}" -F file a.c 2>/dev/null
@@ -125,7 +125,11 @@ testcase() {
 			return 1
 		fi
 	else
-		(cd "${_wrkdir}" && ${EXEC:-} "${KNFMT}" ${_flags:+-${_flags}} "$@" "${_file}") \
+		# Operate on a copy as the style is resolved relative to the
+		# file.
+		[ "${_file}" -ef "${_wrkdir}/${_name}" ] ||
+			cp "${_file}" "${_wrkdir}/${_name}"
+		(cd "${_wrkdir}" && ${EXEC:-} "${KNFMT}" ${_flags:+-${_flags}} "$@" "${_name}") \
 			>"${_out}" 2>&1 || _got="$?"
 	fi
 
@@ -0,0 +1,38 @@
+# Ensure the language server answers formatting requests using edits confined
+# to the changed lines.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+_msg() {
+	printf 'Content-Length: %d\r\n\r\n%s' "${#1}" "$1"
+}
+
+_uri="file://${_wrkdir}/a%2Ec"
+_doc="{\"textDocument\":{\"uri\":\"${_uri}\"}"
+
+{
+	_msg '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{}}'
+	_msg '{"jsonrpc":"2.0","method":"initialized","params":{}}'
+	_msg "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"${_uri}\",\"text\":\"int a=1;\\nint b = 2;\\nint c=3;\\n\"}}}"
+	_msg "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"textDocument/formatting\",\"params\":${_doc}}}"
+	_msg "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"textDocument/rangeFormatting\",\"params\":${_doc},\"range\":{\"start\":{\"line\":2,\"character\":0},\"end\":{\"line\":3,\"character\":0}}}}"
+	_msg "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":${_doc},\"contentChanges\":[{\"text\":\"int a = 1;\\n\"}]}}"
+	_msg "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"textDocument/formatting\",\"params\":${_doc}}}"
+	_msg '{"jsonrpc":"2.0","id":5,"method":"textDocument/hover","params":{}}'
+	_msg '{"jsonrpc":"2.0","id":6,"method":"shutdown"}'
+	_msg '{"jsonrpc":"2.0","method":"exit"}'
+} >in
+${EXEC:-} "${KNFMT}" -L <in | tr -d '\r' | grep '^{' >out
+
+grep -q '"id":1,"result":{"capabilities":{' out
+grep -q '"id":2,"result":\[{"range":{"start":{"line":0,"character":0},"end":{"line":1,"character":0}},"newText":"int a = 1;\\n"},{"range":{"start":{"line":2,"character":0},"end":{"line":3,"character":0}},"newText":"int c = 3;\\n"}\]' out
+grep -q '"id":3,"result":\[{"range":{"start":{"line":2,"character":0},"end":{"line":3,"character":0}},"newText":"int c = 3;\\n"}\]' out
+grep -q '"id":4,"result":\[\]' out
+grep -q '"id":5,"error":{"code":-32601,' out
+grep -q '"id":6,"result":null' out
@@ -0,0 +1,47 @@
+# Ensure files formatted through the server are identical to files formatted
+# directly.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+_pid=""
+trap '[ -z "${_pid}" ] || kill "${_pid}"; rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+printf 'int a=1;\n' >a.c
+printf 'int b = 2;\n' >b.c
+printf 'int c = {\n' >c.c
+
+${EXEC:-} "${KNFMT}" -S sock &
+_pid="$!"
+_i=0
+while ! [ -S sock ]; do
+	_i=$((_i + 1))
+	[ "${_i}" -lt 100 ]
+	sleep 0.1
+done
+
+${EXEC:-} "${KNFMT}" -R sock a.c b.c >out
+diff -u - out <<EOF1
+int a = 1;
+int b = 2;
+EOF1
+
+! ${EXEC:-} "${KNFMT}" -R sock -d a.c >out
+grep -q '^+int a = 1;$' out
+
+# Diagnostics are forwarded to the client.
+! ${EXEC:-} "${KNFMT}" -R sock c.c >out 2>err
+grep -q 'c.c:1: error' err
+
+${EXEC:-} "${KNFMT}" -R sock -i a.c
+diff -u - a.c <<EOF1
+int a = 1;
+EOF1
+
+kill "${_pid}"
+wait "${_pid}"
+_pid=""
+! [ -e sock ]
@@ -0,0 +1,25 @@
+/*
+ * IncludeBlocks: Regroup
+ * IncludeCategories:
+ *   - Regex: '^<sys/types\.h>'
+ *     Priority: 1
+ *   - Regex: '^<sys/'
+ *     Priority: 2
+ *   - Regex: '^"x*y'
+ *     Priority: 3
+ *   - Regex: '^"LIB/|^"foo'
+ *     Priority: 4
+ *   - Regex: '\.h"$'
+ *     Priority: 5
+ *   - Regex: '^<'
+ *     Priority: 6
+ * SortIncludes: CaseSensitive
+ */
+
+#include <stdio.h>
+#include "bar.h"
+#include "foo"
+#include "lib/x.h"
+#include "y.h"
+#include <SYS/stat.h>
+#include <sys/types.h>
@@ -0,0 +1,40 @@
+# Ensure compiled styles are honored.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+# Stub only available during the first invocation, causing a style based on
+# another style to only be applicable if compiled.
+mkdir bin
+cat <<'EOF1' >bin/clang-format
+#!/bin/sh
+printf 'IndentWidth: 4\nUseTab: Never\n'
+EOF1
+chmod u+x bin/clang-format
+
+printf 'BasedOnStyle: LLVM\nColumnLimit: 100\n' >.clang-format
+printf 'int\nmain(void)\n{\n\treturn 0;\n}\n' >test.c
+
+cat <<'EOF1' >exp
+int
+main(void)
+{
+    return 0;
+}
+EOF1
+
+PATH="${_wrkdir}/bin:${PATH}" ${EXEC:-} "${KNFMT}" -C cache test.c >out
+diff -u exp out
+rm -r bin
+${EXEC:-} "${KNFMT}" -C cache test.c >out
+diff -u exp out
+
+# Compiled style must be invalidated once the configuration changes.
+printf 'ColumnLimit: 100\n' >.clang-format
+${EXEC:-} "${KNFMT}" -C cache test.c >out
+diff -u test.c out
@@ -0,0 +1,40 @@
+# Ensure the nearest clang-format configuration is honored for each file.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+mkdir -p a/b c
+printf 'UseTab: Never\nIndentWidth: 4\n' >a/.clang-format
+printf 'IndentWidth: 2\n' >a/b/.clang-format
+for _f in a/x.c a/b/x.c a/b/y.c c/x.c; do
+	printf 'int\nmain(void)\n{\n\treturn 0;\n}\n' >"${_f}"
+done
+
+${EXEC:-} "${KNFMT}" a/x.c a/b/x.c a/b/y.c c/x.c >"${_wrkdir}/out"
+diff -u - "${_wrkdir}/out" <<'EOF1'
+int
+main(void)
+{
+    return 0;
+}
+int
+main(void)
+{
+  return 0;
+}
+int
+main(void)
+{
+  return 0;
+}
+int
+main(void)
+{
+	return 0;
+}
+EOF1
@@ -0,0 +1,37 @@
+# Ensure timing and memory reports emit one JSON object per file on stderr
+# without affecting the formatted output.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+printf 'int a=1;\n' >a.c
+printf 'int b = 2;\n' >'b"c.c'
+
+${EXEC:-} "${KNFMT}" -tT a.c 'b"c.c' >out 2>err
+diff -u - out <<EOF1
+int a = 1;
+int b = 2;
+EOF1
+[ "$(wc -l <err)" -eq 2 ]
+grep -q '^{"path":"a.c","error":false,"read":[0-9]*,.*,"tokens":6,' err
+grep -q '^{"path":"b\\"c.c",.*"arena_bytes":[0-9]*}$' err
+
+! ${EXEC:-} "${KNFMT}" -tT nonexistent.c >out 2>err
+grep -q '^{"path":"nonexistent.c","error":true,' err
+
+# Statements preceding a branch are skipped while parsing the function again.
+printf 'int\nmain(void)\n{\n\tint a = 1;\n\n' >c.c
+printf '#ifdef A\n\treturn a;\n#else\n\treturn 0;\n#endif\n}\n' >>c.c
+${EXEC:-} "${KNFMT}" -tT c.c >out 2>err
+diff -u c.c out
+grep -q '"branches":1,"recovers":0,"skips":1,' err
+
+# Memory report, high-water marks must be present for all arenas.
+${EXEC:-} "${KNFMT}" -tM a.c >out 2>err
+grep -q '^{"path":"a.c","error":false,"memory":{"read":{"eternal":{' err
+grep -q '"doc":{"eternal":{.*"ruler":{"bytes":[0-9]*,"max_bytes":[0-9]*,' err
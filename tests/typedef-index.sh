@@ -0,0 +1,47 @@
+# Ensure typedef names declared in headers are recognized as types.
+
+set -e
+
+[ -z "${VALGRINDRC:-}" ] || export "VALGRIND_OPTS=$(xargs <"${VALGRINDRC}")"
+
+_wrkdir="$(mktemp -dt knfmt.XXXXXX)"
+trap 'rm -r $_wrkdir' EXIT
+cd "${_wrkdir}"
+
+mkdir include
+cat <<'EOF1' >include/a.h
+typedef unsigned long foo_t;
+typedef int (*fn_t)(int *);
+typedef void (*cb_t)(char **argv, int **n);
+typedef int count;
+EOF1
+printf 'int x = (foo_t) - 1;\nint y = (fn_t) * p;\n' >a.c
+printf 'int x = (n) * 2;\nint y = (argv) & mask;\n' >b.c
+
+# Without the index, the casts are considered binary expressions.
+${EXEC:-} "${KNFMT}" a.c | grep -q 'x = (foo_t) - 1;'
+
+# Headers found by directory walk.
+${EXEC:-} "${KNFMT}" -T index a.c >out
+printf 'int x = (foo_t)-1;\nint y = (fn_t)*p;\n' | diff -u - out
+
+# Parameters of function pointers are not types.
+${EXEC:-} "${KNFMT}" -T index b.c | diff -u b.c -
+
+# Variables shadowing indexed type names.
+cat <<'EOF1' >c.c
+int
+f(int count)
+{
+	count++;
+	count = count * 2;
+	return count;
+}
+EOF1
+${EXEC:-} "${KNFMT}" -T index c.c | diff -u c.c -
+
+# Headers given on the command line.
+${EXEC:-} "${KNFMT}" -T index include/a.h a.c | grep -q 'x = (foo_t)-1;'
+
+! ${EXEC:-} "${KNFMT}" -T index -R socket a.c 2>/dev/null
+! ${EXEC:-} "${KNFMT}" -T nonexistent/index a.c 2>/dev/null
@@ -0,0 +1,29 @@
+/*
+ * Statements preceding a branch are skipped while parsing the same function
+ * again.
+ */
+
+int
+main(void)
+{
+	int a = 1;
+	int bb = 2;
+
+	if (a) {
+		a++;
+		bb++;
+#if defined(A)
+		a = bb;
+#else
+		bb = a;
+#endif
+		a--;
+	}
+	while (a > 0)
+		a--;
+#ifdef B
+	return a;
+#else
+	return bb;
+#endif
+}
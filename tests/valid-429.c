@@ -0,0 +1,16 @@
+/*
+ * Names introduced by typedef are recognized as types, a subsequent operator
+ * is therefore not binary.
+ */
+
+typedef unsigned long foo_t;
+typedef int (*fn_t)(foo_t);
+
+long
+f(long x, long *p)
+{
+	x = (foo_t) - 1;
+	x = (foo_t) * p;
+	x = (foo_t) & x;
+	return (fn_t) + x != 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Variables shadowing names introduced by typedef.
+ */
+
+typedef int t;
+typedef int (*fn_t)(t);
+
+struct s {
+	int	x;
+};
+
+void
+f(void)
+{
+	int t;
+
+	t++;
+	t--;
+	t *= 2;
+	t += 2;
+	t = 1;
+	t = t ? 1 : 2;
+}
+
+void
+g(struct s t, struct s *fn_t)
+{
+	t.x = 1;
+	fn_t->x = t.x;
+	fn_t[0].x = 1;
+}
+
+void
+h(void (*t)(int), int *fn_t)
+{
+	t(0);
+	fn_t[0] = 1;
+}
@@ -0,0 +1,195 @@
+#include "timing.h"
+
+#include "config.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/compiler.h"
+
+#include "arenas.h"
+#include "json.h"
+
+static const char *arena_names[] = {
+	"eternal",
+	"scratch",
+	"doc",
+	"buffer",
+	"ruler",
+};
+
+/*
+ * Per file wall time spent in each phase and counters, emitted as one JSON
+ * object per line on stderr allowing profiles to be aggregated across many
+ * files. Times are expressed in microseconds. The memory report holds the
+ * usage of each arena at the end of each phase, where the high-water marks
+ * are relative to the beginning of the file. All routines are no-ops if given
+ * a NULL timing, making instrumentation cheap when not requested.
+ */
+struct timing {
+	uint64_t		 phases[TIMING_PHASE_MAX];
+	uint64_t		 counters[TIMING_COUNTER_MAX];
+	/* Time of timing_enter() per phase. */
+	uint64_t		 enter[TIMING_PHASE_MAX];
+	/* Arena usage at timing_leave() per phase. */
+	struct arena_stats	 memory[TIMING_PHASE_MAX][countof(arena_names)];
+	/* Arenas in the same order as arena_names. */
+	struct arena		*arenas[countof(arena_names)];
+	unsigned int		 flags;
+};
+
+static const char *phase_names[] = {
+#define OP(name, str) [TIMING_ ## name] = str,
+	FOR_TIMING_PHASES(OP)
+#undef OP
+};
+
+static const char *counter_names[] = {
+#define OP(name, str) [TIMING_ ## name] = str,
+	FOR_TIMING_COUNTERS(OP)
+#undef OP
+};
+
+static uint64_t	now(void);
+static void	print_clock(const struct timing *);
+static void	print_memory(const struct timing *);
+
+struct timing *
+timing_alloc(struct arena_scope *s, struct arenas *arenas, unsigned int flags)
+{
+	struct timing *ti;
+
+	ti = arena_calloc(s, 1, sizeof(*ti));
+	ti->arenas[0] = arenas->eternal;
+	ti->arenas[1] = arenas->scratch;
+	ti->arenas[2] = arenas->doc;
+	ti->arenas[3] = arenas->buffer;
+	ti->arenas[4] = arenas->ruler;
+	ti->flags = flags;
+	return ti;
+}
+
+void
+timing_reset(struct timing *ti)
+{
+	size_t i;
+
+	if (ti == NULL)
+		return;
+
+	memset(ti->phases, 0, sizeof(ti->phases));
+	memset(ti->counters, 0, sizeof(ti->counters));
+	memset(ti->memory, 0, sizeof(ti->memory));
+	if (ti->flags & TIMING_MEMORY) {
+		for (i = 0; i < countof(ti->arenas); i++)
+			arena_stats_reset(ti->arenas[i]);
+	}
+}
+
+void
+timing_enter(struct timing *ti, enum timing_phase phase)
+{
+	if (ti == NULL)
+		return;
+	ti->enter[phase] = now();
+}
+
+void
+timing_leave(struct timing *ti, enum timing_phase phase)
+{
+	size_t i;
+
+	if (ti == NULL)
+		return;
+
+	ti->phases[phase] += now() - ti->enter[phase];
+	if (ti->flags & TIMING_MEMORY) {
+		for (i = 0; i < countof(ti->arenas); i++)
+			ti->memory[phase][i] = *arena_get_stats(ti->arenas[i]);
+	}
+}
+
+void
+timing_count(struct timing *ti, enum timing_counter counter, uint64_t n)
+{
+	if (ti == NULL)
+		return;
+	ti->counters[counter] += n;
+}
+
+void
+timing_print(const struct timing *ti, const char *path, int error)
+{
+	struct buffer *bf;
+
+	if (ti == NULL)
+		return;
+
+	bf = buffer_alloc(1 << 8);
+	if (bf == NULL)
+		err(1, NULL);
+	json_print_string(bf, path, strlen(path));
+	fprintf(stderr, "{\"path\":%.*s", (int)buffer_get_len(bf),
+	    buffer_get_ptr(bf));
+	buffer_free(bf);
+	fprintf(stderr, ",\"error\":%s", error ? "true" : "false");
+	if (ti->flags & TIMING_CLOCK)
+		print_clock(ti);
+	if (ti->flags & TIMING_MEMORY)
+		print_memory(ti);
+	fprintf(stderr, "}\n");
+}
+
+static uint64_t
+now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return 0;
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+print_clock(const struct timing *ti)
+{
+	int i;
+
+	for (i = 0; i < TIMING_PHASE_MAX; i++) {
+		fprintf(stderr, ",\"%s\":%llu", phase_names[i],
+		    (unsigned long long)(ti->phases[i] / 1000));
+	}
+	for (i = 0; i < TIMING_COUNTER_MAX; i++) {
+		fprintf(stderr, ",\"%s\":%llu", counter_names[i],
+		    (unsigned long long)ti->counters[i]);
+	}
+}
+
+static void
+print_memory(const struct timing *ti)
+{
+	int i;
+
+	fprintf(stderr, ",\"memory\":{");
+	for (i = 0; i < TIMING_PHASE_MAX; i++) {
+		size_t j;
+
+		fprintf(stderr, "%s\"%s\":{", i > 0 ? "," : "", phase_names[i]);
+		for (j = 0; j < countof(arena_names); j++) {
+			const struct arena_stats *as = &ti->memory[i][j];
+
+			fprintf(stderr, "%s\"%s\":{\"bytes\":%zu,"
+			    "\"max_bytes\":%zu,\"frames\":%zu,"
+			    "\"max_frames\":%zu}",
+			    j > 0 ? "," : "", arena_names[j],
+			    as->bytes.now, as->bytes.max,
+			    as->frames.now, as->frames.max);
+		}
+		fprintf(stderr, "}");
+	}
+	fprintf(stderr, "}");
+}
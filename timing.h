@@ -0,0 +1,49 @@
+#include <stdint.h>
+
+#define FOR_TIMING_PHASES(OP)			\
+	OP(READ,		"read")		\
+	OP(LEXER,		"lexer")	\
+	OP(PARSER,		"parser")	\
+	OP(DOC,			"doc")		\
+	OP(WRITE,		"write")
+
+#define FOR_TIMING_COUNTERS(OP)			\
+	OP(TOKENS,		"tokens")	\
+	OP(PEEKS,		"peeks")	\
+	OP(BRANCHES,		"branches")	\
+	OP(RECOVERS,		"recovers")	\
+	OP(SKIPS,		"skips")	\
+	OP(DOCS,		"docs")		\
+	OP(NFITS,		"nfits")	\
+	OP(MINIMIZERS,		"minimizers")	\
+	OP(ARENA_BYTES,		"arena_bytes")
+
+enum timing_phase {
+#define OP(name, ...) TIMING_ ## name,
+	FOR_TIMING_PHASES(OP)
+#undef OP
+	TIMING_PHASE_MAX,
+};
+
+enum timing_counter {
+#define OP(name, ...) TIMING_ ## name,
+	FOR_TIMING_COUNTERS(OP)
+#undef OP
+	TIMING_COUNTER_MAX,
+};
+
+/* Report wall time and counters per phase. */
+#define TIMING_CLOCK	0x00000001u
+/* Report arena usage at the end of each phase. */
+#define TIMING_MEMORY	0x00000002u
+
+struct arena_scope;
+struct arenas;
+
+struct timing	*timing_alloc(struct arena_scope *, struct arenas *,
+    unsigned int);
+void		 timing_reset(struct timing *);
+void		 timing_enter(struct timing *, enum timing_phase);
+void		 timing_leave(struct timing *, enum timing_phase);
+void		 timing_count(struct timing *, enum timing_counter, uint64_t);
+void		 timing_print(const struct timing *, const char *, int);
@@ -9,9 +9,11 @@
 	OP(DIFF,		'D')	\
 	OP(FUNC,		'f')	\
 	OP(LEXER,		'l')	\
+	OP(MEMORY,		'M')	\
 	OP(PARSER,		'p')	\
 	OP(STYLE,		's')	\
 	OP(SIMPLE,		'S')	\
+	OP(TIMING,		'T')	\
 	OP(TOKEN,		't')
 
 enum trace_type {
@@ -0,0 +1,584 @@
+#include "typedef-index.h"
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <limits.h>	/* PATH_MAX */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>	/* mkstemp(3) on Linux */
+#include <string.h>
+#include <unistd.h>
+
+#include "libks/arena-buffer.h"
+#include "libks/arena.h"
+#include "libks/buffer.h"
+#include "libks/map.h"
+
+#include "util.h"
+
+#define TYPEDEF_INDEX_MAGIC	"knfmttd2"
+
+/* Names longer than this are not worth indexing. */
+#define TYPEDEF_INDEX_NAME_MAX	UINT8_MAX
+
+/*
+ * Header of the index file, followed by a hash table of nslots offsets into
+ * the string pool using linear probing. A zero offset denotes an empty slot,
+ * all other offsets are biased by one. Each name in the pool is prefixed with
+ * its length stored in a single byte. The index is stored using the native
+ * byte order as it is only intended to be shared between invocations on the
+ * same machine.
+ */
+struct typedef_index_header {
+	char		magic[8];
+	uint32_t	nslots;
+	uint32_t	nnames;
+};
+
+struct typedef_index {
+	void			*ptr;
+	size_t			 len;
+	const uint32_t		*slots;
+	uint32_t		 nslots;
+	const unsigned char	*pool;
+	size_t			 poollen;
+};
+
+/* Names found while scanning headers, mapped to their offset in the pool. */
+struct typedef_index_builder {
+	MAP(const char, *, uint32_t)	 names;
+	struct buffer			*pool;
+	uint32_t			 nnames;
+};
+
+/*
+ * Minimal C tokenizer, just enough to find the names declared by typedef
+ * declarations. Comments, literals and preprocessor directives are ignored.
+ */
+struct scanner {
+	const char	*ptr;
+	const char	*end;
+	int		 bol;
+};
+
+enum scanner_type {
+	SCANNER_EOF,
+	SCANNER_IDENT,
+	SCANNER_PUNCT,
+};
+
+struct scanner_token {
+	enum scanner_type	 type;
+	const char		*str;
+	size_t			 len;
+};
+
+static void	typedef_index_free(void *);
+
+static int	builder_scan_file(struct typedef_index_builder *,
+    const char *, struct arena *);
+static int	builder_scan_dir(struct typedef_index_builder *,
+    struct arena *);
+static void	builder_scan(struct typedef_index_builder *, const char *,
+    size_t);
+static void	builder_scan_typedef(struct typedef_index_builder *,
+    struct scanner *);
+static void	builder_insert(struct typedef_index_builder *,
+    const struct scanner_token *);
+static int	builder_store(const struct typedef_index_builder *,
+    const char *, struct arena *);
+
+static struct typedef_index	*typedef_index_load(const char *,
+    struct arena_scope *);
+
+static void	scanner_next(struct scanner *, struct scanner_token *);
+static int	scanner_skip(struct scanner *);
+static int	token_is_punct(const struct scanner_token *, char);
+static int	token_is_ident(const struct scanner_token *, const char *);
+
+static uint32_t	hash(const char *, size_t);
+
+/*
+ * Build the typedef index stored at the given path by scanning the given
+ * headers, or all headers found in the current directory and below if none
+ * are given. The index is then mapped into memory, allowing it to be shared
+ * among processes formatting files. Returns NULL on error.
+ */
+struct typedef_index *
+typedef_index_alloc(const char *path, const char *const *headers,
+    size_t nheaders, struct arena_scope *eternal_scope, struct arena *scratch)
+{
+	struct typedef_index_builder b = {0};
+	size_t i;
+	int error = 0;
+
+	if (MAP_INIT(b.names))
+		err(1, NULL);
+	b.pool = buffer_alloc(1 << 12);
+	if (b.pool == NULL)
+		err(1, NULL);
+
+	if (nheaders > 0) {
+		for (i = 0; i < nheaders; i++) {
+			if (builder_scan_file(&b, headers[i], scratch))
+				error = 1;
+		}
+	} else {
+		error = builder_scan_dir(&b, scratch);
+	}
+	if (error == 0 && builder_store(&b, path, scratch))
+		error = 1;
+
+	buffer_free(b.pool);
+	MAP_FREE(b.names);
+	if (error)
+		return NULL;
+	return typedef_index_load(path, eternal_scope);
+}
+
+static void
+typedef_index_free(void *arg)
+{
+	struct typedef_index *ti = arg;
+
+	munmap(ti->ptr, ti->len);
+}
+
+/*
+ * Returns non-zero if the given identifier is declared by a typedef in any of
+ * the indexed headers.
+ */
+int
+typedef_index_find(const struct typedef_index *ti, const char *str,
+    size_t len)
+{
+	uint32_t i, mask, n;
+
+	if (ti == NULL)
+		return 0;
+
+	mask = ti->nslots - 1;
+	i = hash(str, len) & mask;
+	for (n = 0; n < ti->nslots; n++, i = (i + 1) & mask) {
+		const unsigned char *name;
+		size_t off;
+
+		if (ti->slots[i] == 0)
+			return 0;
+		off = ti->slots[i] - 1;
+		if (off >= ti->poollen || ti->pool[off] >= ti->poollen - off)
+			return 0;
+		name = &ti->pool[off];
+		if (name[0] == len && memcmp(&name[1], str, len) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static int
+builder_scan_file(struct typedef_index_builder *b, const char *path,
+    struct arena *scratch)
+{
+	struct buffer *bf;
+
+	arena_scope(scratch, s);
+
+	bf = arena_buffer_read(&s, path);
+	if (bf == NULL) {
+		warn("%s", path);
+		return 1;
+	}
+	builder_scan(b, buffer_get_ptr(bf), buffer_get_len(bf));
+	return 0;
+}
+
+static int
+builder_scan_dir(struct typedef_index_builder *b, struct arena *scratch)
+{
+	char *paths[] = {NULL, NULL};
+	char dot[] = ".";
+	FTS *fts;
+	FTSENT *ent;
+	int error = 0;
+
+	paths[0] = dot;
+	fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+	if (fts == NULL) {
+		warn("fts_open");
+		return 1;
+	}
+	while ((ent = fts_read(fts)) != NULL) {
+		switch (ent->fts_info) {
+		case FTS_D:
+			/* Skip hidden directories such as version control. */
+			if (ent->fts_level > 0 && ent->fts_name[0] == '.')
+				fts_set(fts, ent, FTS_SKIP);
+			break;
+		case FTS_F:
+			if (ent->fts_namelen > 2 && strcmp(
+			    &ent->fts_name[ent->fts_namelen - 2], ".h") == 0 &&
+			    builder_scan_file(b, ent->fts_path, scratch))
+				error = 1;
+			break;
+		default:
+			break;
+		}
+	}
+	fts_close(fts);
+	return error;
+}
+
+static void
+builder_scan(struct typedef_index_builder *b, const char *str, size_t len)
+{
+	struct scanner sc = {
+		.ptr	= str,
+		.end	= &str[len],
+		.bol	= 1,
+	};
+	unsigned int depth = 0;
+
+	for (;;) {
+		struct scanner_token tk;
+
+		scanner_next(&sc, &tk);
+		if (tk.type == SCANNER_EOF)
+			break;
+		if (depth == 0 && token_is_ident(&tk, "typedef"))
+			builder_scan_typedef(b, &sc);
+		else if (token_is_punct(&tk, '{'))
+			depth++;
+		else if (token_is_punct(&tk, '}') && depth > 0)
+			depth--;
+	}
+}
+
+/*
+ * Find the names declared by a typedef, ending with the first semicolon not
+ * nested in any braces. The name is either the identifier followed by a comma,
+ * semicolon or square bracket or the identifier of a function pointer, found in
+ * the first parenthesized group starting with a star. The parameter list
+ * following the declarator group declares nothing and the rest of the typedef
+ * is therefore ignored.
+ */
+static void
+builder_scan_typedef(struct typedef_index_builder *b, struct scanner *sc)
+{
+	struct scanner_token tk;
+	unsigned int depth = 0;
+	int params = 0;
+	/* 1 while inside the declarator group, 2 after. */
+	int group = 0;
+
+	scanner_next(sc, &tk);
+	while (tk.type != SCANNER_EOF) {
+		struct scanner_token nx;
+
+		if (depth == 0 && token_is_punct(&tk, ';'))
+			break;
+		scanner_next(sc, &nx);
+
+		if (tk.type == SCANNER_IDENT) {
+			if (depth == 0 && !params &&
+			    (token_is_punct(&nx, ',') ||
+			     token_is_punct(&nx, ';') ||
+			     token_is_punct(&nx, '[') ||
+			     token_is_ident(&nx, "__attribute__")))
+				builder_insert(b, &tk);
+			else if (depth == 1 && group == 1 &&
+			    (token_is_punct(&nx, ')') ||
+			     token_is_punct(&nx, '[')))
+				builder_insert(b, &tk);
+		} else if (token_is_punct(&tk, '(')) {
+			if (depth == 0 && group == 2)
+				params = 1;
+			else if (depth == 0 && group == 0 &&
+			    token_is_punct(&nx, '*'))
+				group = 1;
+			depth++;
+		} else if (token_is_punct(&tk, '[') ||
+		    token_is_punct(&tk, '{')) {
+			depth++;
+		} else if ((token_is_punct(&tk, ')') ||
+		    token_is_punct(&tk, ']') || token_is_punct(&tk, '}')) &&
+		    depth > 0) {
+			depth--;
+			if (depth == 0 && group == 1)
+				group = 2;
+		}
+
+		tk = nx;
+	}
+}
+
+static void
+builder_insert(struct typedef_index_builder *b, const struct scanner_token *tk)
+{
+	uint32_t *off;
+	unsigned char len;
+
+	if (tk->len > TYPEDEF_INDEX_NAME_MAX)
+		return;
+	if (MAP_FIND_N(b->names, tk->str, tk->len) != NULL)
+		return;
+	off = MAP_INSERT_N(b->names, tk->str, tk->len);
+	if (off == NULL)
+		err(1, NULL);
+	*off = (uint32_t)buffer_get_len(b->pool);
+	len = (unsigned char)tk->len;
+	if (buffer_puts(b->pool, (const char *)&len, 1) == -1 ||
+	    buffer_puts(b->pool, tk->str, tk->len) == -1)
+		err(1, NULL);
+	b->nnames++;
+}
+
+static int
+builder_store(const struct typedef_index_builder *b, const char *path,
+    struct arena *scratch)
+{
+	MAP_ITERATOR(b->names) it = {0};
+	char tmppath[PATH_MAX];
+	struct typedef_index_header th = {0};
+	struct buffer *bf;
+	const char *buf, *pool;
+	uint32_t *slots;
+	uint32_t mask, nslots;
+	size_t buflen;
+	int fd, n;
+
+	arena_scope(scratch, s);
+
+	/* Keep the load factor below one half. */
+	nslots = 1;
+	while (nslots <= b->nnames * 2)
+		nslots <<= 1;
+	mask = nslots - 1;
+	slots = arena_calloc(&s, nslots, sizeof(*slots));
+	pool = buffer_get_ptr(b->pool);
+	while (MAP_ITERATE(b->names, &it)) {
+		uint32_t i, off;
+
+		off = *it.val;
+		i = hash(&pool[off + 1], (unsigned char)pool[off]) & mask;
+		while (slots[i] != 0)
+			i = (i + 1) & mask;
+		slots[i] = off + 1;
+	}
+
+	memcpy(th.magic, TYPEDEF_INDEX_MAGIC, sizeof(th.magic));
+	th.nslots = nslots;
+	th.nnames = b->nnames;
+	bf = arena_buffer_alloc(&s, 1 << 12);
+	buffer_puts(bf, (const char *)&th, sizeof(th));
+	buffer_puts(bf, (const char *)slots, nslots * sizeof(*slots));
+	buffer_puts(bf, pool, buffer_get_len(b->pool));
+
+	n = snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+	if (n < 0 || (size_t)n >= sizeof(tmppath)) {
+		warnx("%s: path too long", path);
+		return 1;
+	}
+	fd = mkstemp(tmppath);
+	if (fd == -1) {
+		warn("%s", tmppath);
+		return 1;
+	}
+	buf = buffer_get_ptr(bf);
+	buflen = buffer_get_len(bf);
+	while (buflen > 0) {
+		ssize_t nw;
+
+		nw = write(fd, buf, buflen);
+		if (nw == -1)
+			break;
+		buf += nw;
+		buflen -= (size_t)nw;
+	}
+	close(fd);
+	if (buflen > 0 || rename(tmppath, path) == -1) {
+		warn("%s", path);
+		(void)unlink(tmppath);
+		return 1;
+	}
+	return 0;
+}
+
+static struct typedef_index *
+typedef_index_load(const char *path, struct arena_scope *eternal_scope)
+{
+	struct typedef_index_header th;
+	struct stat sb;
+	struct typedef_index *ti;
+	void *ptr;
+	size_t len, off;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		warn("%s", path);
+		return NULL;
+	}
+	if (fstat(fd, &sb) == -1) {
+		warn("%s", path);
+		close(fd);
+		return NULL;
+	}
+	len = (size_t)sb.st_size;
+	if (len < sizeof(th)) {
+		warnx("%s: invalid typedef index", path);
+		close(fd);
+		return NULL;
+	}
+	ptr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		warn("%s", path);
+		return NULL;
+	}
+
+	memcpy(&th, ptr, sizeof(th));
+	off = sizeof(th) + (size_t)th.nslots * sizeof(uint32_t);
+	if (memcmp(th.magic, TYPEDEF_INDEX_MAGIC, sizeof(th.magic)) != 0 ||
+	    th.nslots == 0 || (th.nslots & (th.nslots - 1)) != 0 ||
+	    th.nnames >= th.nslots || off > len) {
+		warnx("%s: invalid typedef index", path);
+		munmap(ptr, len);
+		return NULL;
+	}
+
+	ti = arena_calloc(eternal_scope, 1, sizeof(*ti));
+	arena_cleanup(eternal_scope, typedef_index_free, ti);
+	ti->ptr = ptr;
+	ti->len = len;
+	ti->slots = (const uint32_t *)((const char *)ptr + sizeof(th));
+	ti->nslots = th.nslots;
+	ti->pool = (const unsigned char *)ptr + off;
+	ti->poollen = len - off;
+	return ti;
+}
+
+static void
+scanner_next(struct scanner *sc, struct scanner_token *tk)
+{
+	for (;;) {
+		if (sc->ptr == sc->end) {
+			*tk = (struct scanner_token){.type = SCANNER_EOF};
+			return;
+		}
+		if (!scanner_skip(sc))
+			break;
+	}
+
+	tk->str = sc->ptr;
+	if (*sc->ptr == '_' || (*sc->ptr >= 'a' && *sc->ptr <= 'z') ||
+	    (*sc->ptr >= 'A' && *sc->ptr <= 'Z')) {
+		tk->type = SCANNER_IDENT;
+		while (sc->ptr < sc->end && (*sc->ptr == '_' ||
+		    (*sc->ptr >= 'a' && *sc->ptr <= 'z') ||
+		    (*sc->ptr >= 'A' && *sc->ptr <= 'Z') ||
+		    (*sc->ptr >= '0' && *sc->ptr <= '9')))
+			sc->ptr++;
+	} else {
+		tk->type = SCANNER_PUNCT;
+		sc->ptr++;
+	}
+	tk->len = (size_t)(sc->ptr - tk->str);
+	sc->bol = 0;
+}
+
+/*
+ * Skip any whitespace, comment, literal or preprocessor directive at the
+ * current position. Returns non-zero if anything was skipped.
+ */
+static int
+scanner_skip(struct scanner *sc)
+{
+	const char *p = sc->ptr;
+	char c = *p;
+
+	if (c == '\n') {
+		sc->ptr++;
+		sc->bol = 1;
+		return 1;
+	}
+	if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+		sc->ptr++;
+		return 1;
+	}
+
+	if (c == '#' && sc->bol) {
+		/*
+		 * Preprocessor directive, honoring line continuations and
+		 * comments spanning multiple lines.
+		 */
+		for (; p < sc->end && *p != '\n'; p++) {
+			if (*p == '\\' && p + 1 < sc->end && p[1] == '\n') {
+				p++;
+			} else if (*p == '/' && p + 1 < sc->end &&
+			    p[1] == '*') {
+				for (p += 2; p + 1 < sc->end; p++) {
+					if (p[0] == '*' && p[1] == '/')
+						break;
+				}
+				p++;
+			}
+		}
+		sc->ptr = p < sc->end ? p : sc->end;
+		return 1;
+	}
+
+	if (c == '/' && p + 1 < sc->end && p[1] == '*') {
+		for (p += 2; p + 1 < sc->end; p++) {
+			if (p[0] == '*' && p[1] == '/')
+				break;
+		}
+		sc->ptr = p + 1 < sc->end ? p + 2 : sc->end;
+		return 1;
+	}
+	if (c == '/' && p + 1 < sc->end && p[1] == '/') {
+		while (p < sc->end && *p != '\n')
+			p++;
+		sc->ptr = p;
+		return 1;
+	}
+
+	if (c == '"' || c == '\'') {
+		for (p++; p < sc->end && *p != c && *p != '\n'; p++) {
+			if (*p == '\\' && p + 1 < sc->end)
+				p++;
+		}
+		sc->ptr = p < sc->end ? p + 1 : sc->end;
+		sc->bol = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+token_is_punct(const struct scanner_token *tk, char c)
+{
+	return tk->type == SCANNER_PUNCT && tk->str[0] == c;
+}
+
+static int
+token_is_ident(const struct scanner_token *tk, const char *str)
+{
+	size_t len = strlen(str);
+
+	return tk->type == SCANNER_IDENT && tk->len == len &&
+	    strncmp(tk->str, str, len) == 0;
+}
+
+static uint32_t
+hash(const char *str, size_t len)
+{
+	return (uint32_t)hash_fnv1a(FNV1A_INIT, str, len);
+}
@@ -0,0 +1,9 @@
+#include <stddef.h>	/* size_t */
+
+struct arena;
+struct arena_scope;
+
+struct typedef_index	*typedef_index_alloc(const char *,
+    const char *const *, size_t, struct arena_scope *, struct arena *);
+int			 typedef_index_find(const struct typedef_index *,
+    const char *, size_t);
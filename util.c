@@ -3,6 +3,7 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "libks/arena-buffer.h"
 #include "libks/buffer.h"
@@ -123,3 +124,39 @@ strindent_buffer(struct buffer *bf, size_t indent, int usetabs, size_t pos)
 	}
 	return pos;
 }
+
+/*
+ * Append exactly len bytes read from the stream to the buffer.
+ */
+int
+read_buffer(FILE *fp, struct buffer *bf, size_t len)
+{
+	char buf[1 << 12];
+
+	while (len > 0) {
+		size_t n;
+
+		n = fread(buf, 1, len < sizeof(buf) ? len : sizeof(buf), fp);
+		if (n == 0)
+			return 1;
+		buffer_puts(bf, buf, n);
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * FNV-1a hash of the given string, continuing from the given hash allowing
+ * multiple strings to be hashed. The first hash must be FNV1A_INIT.
+ */
+uint64_t
+hash_fnv1a(uint64_t h, const char *str, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)str[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
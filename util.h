@@ -1,4 +1,9 @@
 #include <stddef.h>	/* size_t */
+#include <stdint.h>	/* uint64_t */
+#include <stdio.h>	/* FILE */
+
+/* Initial hash, see hash_fnv1a(). */
+#define FNV1A_INIT	0xcbf29ce484222325ULL
 
 struct arena_scope;
 struct buffer;
@@ -9,3 +14,7 @@ unsigned int	colwidth(const char *, size_t, unsigned int);
 size_t		strwidth(const char *, size_t, size_t);
 
 size_t	strindent_buffer(struct buffer *, size_t, int, size_t);
+
+int	read_buffer(FILE *, struct buffer *, size_t);
+
+uint64_t	hash_fnv1a(uint64_t, const char *, size_t);